@@ -14,7 +14,13 @@
 #include <opencv2/xfeatures2d/nonfree.hpp>
 
 #include "dataStructures.h"
+#include "ringBuffer.h"
 #include "matching2D.hpp"
+#include "pipeline.hpp"
+#include "instrumentation.hpp"
+#include "configLoader.hpp"
+#include "matPool.hpp"
+#include "visualizationSink.hpp"
 
 using namespace std;
 
@@ -24,188 +30,113 @@ int main(int argc, const char *argv[])
 
     /* INIT VARIABLES AND DATA STRUCTURES */
 
+    PipelineConfig cfg;
+
     // data location
     string dataPath = "../";
 
     // camera
-    string imgBasePath = dataPath + "images/";
-    string imgPrefix = "KITTI/2011_09_26/image_00/data/000000"; // left camera, color
-    string imgFileType = ".png";
-    int imgStartIndex = 0; // first file index to load (assumes Lidar and camera names have identical naming convention)
-    int imgEndIndex = 9;   // last file index to load
-    int imgFillWidth = 4;  // no. of digits which make up the file index (e.g. img-0001.png)
+    cfg.sourceType = "IMAGES"; // IMAGES, VIDEO (cfg.sourceUri = file, URL or camera index), RAW (cfg.sourceUri = dump file)
+    cfg.imgBasePath = dataPath + "images/";
+    cfg.imgPrefix = "KITTI/2011_09_26/image_00/data/000000"; // left camera, color
+    cfg.imgFileType = ".png";
+    cfg.imgStartIndex = 0; // first file index to load (assumes Lidar and camera names have identical naming convention)
+    cfg.imgEndIndex = 9;   // last file index to load
+    cfg.imgFillWidth = 4;  // no. of digits which make up the file index (e.g. img-0001.png)
 
     // misc
-    int dataBufferSize = 2;       // no. of images which are held in memory (ring buffer) at the same time
-    vector<DataFrame> dataBuffer; // list of data frames which are held in memory at the same time
-    bool bVis = false;            // visualize results
-
-    /* MAIN LOOP OVER ALL IMAGES */
-
-    for (size_t imgIndex = 0; imgIndex <= imgEndIndex - imgStartIndex; imgIndex++)
+    cfg.dataBufferSize = 2; // no. of images which are held in memory (ring buffer) at the same time
+    cfg.visSink = "NONE";   // visualize matches: NONE, WINDOW, VIDEO or SHM (written to cfg.visPath), never blocks
+    cfg.bLogStages = false;    // print per-stage messages to stdout
+    cfg.bInstrument = true;    // record per-stage timers and counters
+    cfg.bStageSummary = false; // print the per-stage latency histograms to stdout at the end
+    cfg.traceFile = "";        // write a Chrome trace of the run to this file (empty -> no trace)
+
+    // processing pipeline
+    cfg.detectorType = "BRISK";        // SHITOMASI, HARRIS, FAST, BRISK, ORB, AKAZE, SIFT
+    cfg.descriptorType = "AKAZE";      // BRIEF, ORB, FREAK, AKAZE, SIFT
+    cfg.matcherType = "MAT_FLANN";     // MAT_BF, MAT_FLANN, MAT_HAMMING
+    cfg.descriptorClass = "DES_BINARY"; // DES_BINARY, DES_HOG
+    cfg.selectorType = "SEL_KNN";      // SEL_NN, SEL_KNN
+    cfg.bGatedMatching = false;        // true -> only match keypoints close to their predicted position
+    cfg.bTiledDetection = false;       // true -> detect SHITOMASI, HARRIS, FAST tile by tile on all cores
+    cfg.bKltTracking = false;          // true -> track keypoints with optical flow, re-detect every cfg.redetectInterval frames
+
+    // execution
+    cfg.bPipelined = false; // true -> load, detect/describe and match frames on separate threads
+    cfg.prefetchSize = 4;   // no. of images decoded ahead of the pipeline (0 -> load synchronously)
+    cfg.bPoolMats = true;   // reuse the image, response and descriptor buffers of previous frames
+
+    // settings from the command line (--key value) or a config file (--config FILE) override the ones above
+    if (argc > 1 && string(argv[1]).compare("--help") == 0)
     {
-        /* LOAD IMAGE INTO BUFFER */
-
-        // assemble filenames for current index
-        ostringstream imgNumber;
-        imgNumber << setfill('0') << setw(imgFillWidth) << imgStartIndex + imgIndex;
-        string imgFullFilename = imgBasePath + imgPrefix + imgNumber.str() + imgFileType;
-
-        // load image from file and convert to grayscale
-        cv::Mat img, imgGray;
-        img = cv::imread(imgFullFilename);
-        cv::cvtColor(img, imgGray, cv::COLOR_BGR2GRAY);
-
-        //// STUDENT ASSIGNMENT
-        //// TASK MP.1 -> replace the following code with ring buffer of size dataBufferSize
-
-        // push image into data frame buffer
-        DataFrame frame;
-        frame.cameraImg = imgGray;
-		if (dataBuffer.size() >= dataBufferSize) {
-			dataBuffer.erase(dataBuffer.begin());
-		}
-        dataBuffer.push_back(frame);
-
-        //// EOF STUDENT ASSIGNMENT
-        cout << "#1 : LOAD IMAGE INTO BUFFER done" << endl;
-
-        /* DETECT IMAGE KEYPOINTS */
-
-        // extract 2D keypoints from current image
-        vector<cv::KeyPoint> keypoints; // create empty feature list for current image
-        string detectorType = "BRISK";
+        cout << "Usage: " << argv[0] << " [--config FILE] [--key value | --key=value ...]\n"
+             << "Keys with their current values:\n";
+        writeConfig(cout, cfg);
+        return 0;
+    }
+    try
+    {
+        applyCommandLine(argc, argv, cfg);
+        validateConfig(cfg);
+    }
+    catch (const exception &e)
+    {
+        cerr << e.what() << endl;
+        return 1;
+    }
 
-        //// STUDENT ASSIGNMENT
-        //// TASK MP.2 -> add the following keypoint detectors in file matching2D.cpp and enable string-based selection based on detectorType
-        //// -> HARRIS, FAST, BRISK, ORB, AKAZE, FREAK, SIFT
+    setStageLogging(cfg.bLogStages);
+    setInstrumentationEnabled(cfg.bInstrument);
+    if (cfg.bPoolMats)
+    {
+        enableMatPool();
+    }
 
-        if (detectorType.compare("SHITOMASI") == 0)
-        {
-            detKeypointsShiTomasi(keypoints, imgGray, true);
-        }
-        else if(detectorType.compare("HARRIS") == 0)
-        {
-			detKeypointsHarris(keypoints, imgGray, false);
-        }
-		else if(detectorType.compare("FAST") == 0 ||
-			    detectorType.compare("BRISK") == 0 ||
-			    detectorType.compare("ORB") == 0 ||
-				detectorType.compare("AKAZE") == 0 ||
-				detectorType.compare("FREAK") == 0 ||
-				detectorType.compare("SIFT") == 0)
-		{
-			detKeypointsModern(keypoints, imgGray, detectorType, false);
-		}
-		else
-		{
-			// Do nothing
-		}
-        //// EOF STUDENT ASSIGNMENT
-
-        //// STUDENT ASSIGNMENT
-        //// TASK MP.3 -> only keep keypoints on the preceding vehicle
-
-        // only keep keypoints on the preceding vehicle
-        bool bFocusOnVehicle = true;
-        cv::Rect vehicleRect(535, 180, 180, 150);
-        if (bFocusOnVehicle)
-        {
-			for (auto it = keypoints.begin(); it != keypoints.end();) {
-				if (!vehicleRect.contains((*it).pt)) {
-					it = keypoints.erase(it);
-				}
+    /* MAIN LOOP OVER ALL IMAGES */
 
-				else {
-					++it;
-				}
-			}
+    // visualize matches between current and previous image on a render thread, without a callback if disabled
+    unique_ptr<MatchVisualizer> visualizer = createMatchVisualizer(cfg);
+    FrameCallback onFrame;
+    if (visualizer)
+    {
+        MatchVisualizer *vis = visualizer.get();
+        onFrame = [vis](RingBuffer<DataFrame> &dataBuffer) { vis->submit(dataBuffer); };
+    }
 
-			std::cout << "NOTE: Number of keypoints only on the car is " << keypoints.size() << std::endl;
-        }
+    PipelineStats stats = runPipeline(cfg, onFrame); // eof loop over all images
 
-        //// EOF STUDENT ASSIGNMENT
+    cout << "Processed " << stats.frames << " frames in " << 1000 * stats.seconds << " ms";
+    if (stats.seconds > 0.0) // an empty or failed source runs for no measurable time
+    {
+        cout << " (" << stats.frames / stats.seconds << " fps)";
+    }
+    cout << endl;
+    if (cfg.prefetchSize > 0)
+    {
+        cout << "Image prefetch: " << stats.prefetch.hits << " hits, " << stats.prefetch.stalls << " stalls ("
+             << 1000 * stats.prefetch.stallSeconds << " ms waiting)" << endl;
+    }
+    if (visualizer)
+    {
+        visualizer->close();
+        VisualizerStats vis = visualizer->stats();
+        cout << "Visualization: " << vis.rendered << " of " << vis.submitted << " frame pairs rendered, "
+             << vis.dropped << " dropped" << endl;
+    }
 
-        // optional : limit number of keypoints (helpful for debugging and learning)
-        bool bLimitKpts = true;
-        if (bLimitKpts)
+    if (cfg.bInstrument)
+    {
+        if (cfg.bStageSummary)
         {
-            int maxKeypoints = 50;
-
-            if (detectorType.compare("SHITOMASI") == 0)
-            { // there is no response info, so keep the first 50 as they are sorted in descending quality order
-                keypoints.erase(keypoints.begin() + maxKeypoints, keypoints.end());
-            }
-            cv::KeyPointsFilter::retainBest(keypoints, maxKeypoints);
-            cout << " NOTE: Keypoints have been limited!" << endl;
+            writeStageHistograms(cout);
         }
-
-        // push keypoints and descriptor for current frame to end of data buffer
-        (dataBuffer.end() - 1)->keypoints = keypoints;
-        cout << "#2 : DETECT KEYPOINTS done" << endl;
-
-        /* EXTRACT KEYPOINT DESCRIPTORS */
-
-        //// STUDENT ASSIGNMENT
-        //// TASK MP.4 -> add the following descriptors in file matching2D.cpp and enable string-based selection based on descriptorType
-        //// -> BRIEF, ORB, FREAK, AKAZE, SIFT
-
-        cv::Mat descriptors;
-        string descriptorType = "AKAZE"; // BRIEF, ORB, FREAK, AKAZE, SIFT
-        descKeypoints((dataBuffer.end() - 1)->keypoints, (dataBuffer.end() - 1)->cameraImg, descriptors, descriptorType);
-        //// EOF STUDENT ASSIGNMENT
-
-        // push descriptors for current frame to end of data buffer
-        (dataBuffer.end() - 1)->descriptors = descriptors;
-
-        cout << "#3 : EXTRACT DESCRIPTORS done" << endl;
-
-        if (dataBuffer.size() > 1) // wait until at least two images have been processed
+        if (!cfg.traceFile.empty())
         {
-
-            /* MATCH KEYPOINT DESCRIPTORS */
-
-            vector<cv::DMatch> matches;
-            string matcherType = "MAT_FLANN";        // MAT_BF, MAT_FLANN
-            string descriptorType = "DES_BINARY"; // DES_BINARY, DES_HOG
-            string selectorType = "SEL_KNN";       // SEL_NN, SEL_KNN
-
-            //// STUDENT ASSIGNMENT
-            //// TASK MP.5 -> add FLANN matching in file matching2D.cpp
-            //// TASK MP.6 -> add KNN match selection and perform descriptor distance ratio filtering with t=0.8 in file matching2D.cpp
-
-            matchDescriptors((dataBuffer.end() - 2)->keypoints, (dataBuffer.end() - 1)->keypoints,
-                             (dataBuffer.end() - 2)->descriptors, (dataBuffer.end() - 1)->descriptors,
-                             matches, descriptorType, matcherType, selectorType);
-
-            //// EOF STUDENT ASSIGNMENT
-
-            // store matches in current data frame
-            (dataBuffer.end() - 1)->kptMatches = matches;
-
-            cout << "#4 : MATCH KEYPOINT DESCRIPTORS done" << endl;
-
-            // visualize matches between current and previous image
-            bVis = true;
-            if (bVis)
-            {
-                cv::Mat matchImg = ((dataBuffer.end() - 1)->cameraImg).clone();
-                cv::drawMatches((dataBuffer.end() - 2)->cameraImg, (dataBuffer.end() - 2)->keypoints,
-                                (dataBuffer.end() - 1)->cameraImg, (dataBuffer.end() - 1)->keypoints,
-                                matches, matchImg,
-                                cv::Scalar::all(-1), cv::Scalar::all(-1),
-                                vector<char>(), cv::DrawMatchesFlags::DRAW_RICH_KEYPOINTS);
-
-                string windowName = "Matching keypoints between two camera images";
-                cv::namedWindow(windowName, 7);
-                cv::imshow(windowName, matchImg);
-                cout << "Press key to continue to next image" << endl;
-                cv::waitKey(0); // wait for key to be pressed
-            }
-            bVis = false;
+            ofstream trace(cfg.traceFile);
+            writeChromeTrace(trace);
         }
-
-    } // eof loop over all images
+    }
 
     return 0;
 }
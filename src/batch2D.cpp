@@ -0,0 +1,277 @@
+/* INCLUDES FOR THIS PROJECT */
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <mutex>
+#include <thread>
+#include <algorithm>
+#include <exception>
+#include <cstdlib>
+#include <opencv2/core.hpp>
+
+#include "dataStructures.h"
+#include "ringBuffer.h"
+#include "pipeline.hpp"
+#include "configLoader.hpp"
+#include "threadPool.hpp"
+
+using namespace std;
+
+struct SequenceJob { // one line of the manifest
+    string name;
+    PipelineConfig cfg;
+};
+
+struct SequenceResult { // outcome of processing one sequence
+    string name;
+    string error; // set if the sequence failed
+    size_t frames = 0;
+    double seconds = 0.0;
+    double keypointsPerFrame = 0.0;
+    double matchesPerFrame = 0.0;
+};
+
+// The pool provides the parallelism, every sequence runs its stages one after another on its worker
+static void forceBatchSettings(PipelineConfig &cfg)
+{
+    cfg.bPipelined = false;
+    cfg.prefetchSize = 0;
+    cfg.bVisKeypoints = false;
+    cfg.visSink = "NONE";
+}
+
+// Manifest: one sequence per line, "name basePath prefix fileType startIndex endIndex [fillWidth] [key=value ...]",
+// empty lines and lines starting with '#' are skipped. endIndex < startIndex reads until the first missing file.
+// The key=value settings (PipelineConfig keys as in a config file, config=FILE loads a whole file) apply to this
+// sequence only, on top of the defaults; values cannot contain spaces.
+static vector<SequenceJob> readManifest(const string &filename, const PipelineConfig &defaults)
+{
+    ifstream is(filename);
+    if (!is)
+    {
+        throw runtime_error("could not open manifest " + filename);
+    }
+
+    vector<SequenceJob> jobs;
+    string line;
+    for (int lineNo = 1; getline(is, line); ++lineNo)
+    {
+        istringstream fields(line);
+        SequenceJob job;
+        job.cfg = defaults;
+        if (!(fields >> job.name) || job.name[0] == '#')
+        {
+            continue;
+        }
+        string where = filename + ":" + to_string(lineNo) + ": ";
+        if (!(fields >> job.cfg.imgBasePath >> job.cfg.imgPrefix >> job.cfg.imgFileType >> job.cfg.imgStartIndex >> job.cfg.imgEndIndex))
+        {
+            throw runtime_error(where + "expected name basePath prefix fileType startIndex endIndex [fillWidth] [key=value ...]");
+        }
+        try
+        {
+            string token;
+            for (bool bFirst = true; fields >> token; bFirst = false)
+            {
+                size_t eq = token.find('=');
+                if (eq == string::npos && bFirst)
+                {
+                    setConfigValue(job.cfg, "imgFillWidth", token);
+                }
+                else if (eq == string::npos)
+                {
+                    throw invalid_argument("expected key=value instead of " + token);
+                }
+                else if (token.compare(0, eq, "config") == 0)
+                {
+                    loadConfigFile(token.substr(eq + 1), job.cfg);
+                }
+                else
+                {
+                    setConfigValue(job.cfg, token.substr(0, eq), token.substr(eq + 1));
+                }
+            }
+            forceBatchSettings(job.cfg);
+            validateConfig(job.cfg);
+        }
+        catch (const exception &e)
+        {
+            throw runtime_error(where + e.what());
+        }
+        jobs.push_back(job);
+    }
+    return jobs;
+}
+
+static string csvEscape(const string &str)
+{
+    string out = "\"";
+    for (auto it = str.begin(); it != str.end(); ++it)
+    {
+        out += (*it == '"') ? "\"\"" : string(1, *it == '\n' ? ' ' : *it);
+    }
+    return out + "\"";
+}
+
+static SequenceResult processSequence(const SequenceJob &job)
+{
+    SequenceResult result;
+    result.name = job.name;
+    size_t keypoints = 0, matches = 0, matchedFrames = 0;
+    try
+    {
+        PipelineStats stats = runPipeline(job.cfg, [&](RingBuffer<DataFrame> &dataBuffer) {
+            keypoints += dataBuffer.current().keypoints.size();
+            if (dataBuffer.size() > 1)
+            {
+                matches += dataBuffer.current().kptMatches.size();
+                ++matchedFrames;
+            }
+        });
+        result.frames = stats.frames;
+        result.seconds = stats.seconds;
+        result.keypointsPerFrame = stats.frames > 0 ? (double)keypoints / stats.frames : 0.0;
+        result.matchesPerFrame = matchedFrames > 0 ? (double)matches / matchedFrames : 0.0;
+    }
+    catch (const exception &e)
+    {
+        result.error = e.what();
+    }
+    return result;
+}
+
+static void printUsage(const char *name)
+{
+    cout << "Usage: " << name << " MANIFEST [--workers N] [--out FILE] [--config FILE] [--key value | --key=value ...]" << endl
+         << "Pipeline settings on the command line apply to all sequences, those on a manifest line to that sequence" << endl;
+}
+
+/* MAIN PROGRAM */
+int main(int argc, const char *argv[])
+{
+    if (argc < 2)
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+    string manifestFile = argv[1];
+    string outFile = "batch.csv";
+    int numCores = max(1, (int)thread::hardware_concurrency());
+    int numWorkers = 0; // 0 -> one per core, capped by the no. of sequences
+
+    // the vehicle ROI of the default config belongs to the sample sequence, other sequences set their own
+    PipelineConfig defaults;
+    defaults.bFocusOnVehicle = false;
+
+    // the batch options are taken out here, everything else is a pipeline setting for the config loader
+    vector<const char *> pipelineArgs = {argv[0]};
+    for (int i = 2; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (arg == "--workers" && i + 1 < argc)
+        {
+            numWorkers = max(1, atoi(argv[++i]));
+        }
+        else if (arg == "--out" && i + 1 < argc)
+        {
+            outFile = argv[++i];
+        }
+        else if (arg.compare(0, 2, "--") == 0)
+        {
+            pipelineArgs.push_back(argv[i]);
+            if (arg.find('=') == string::npos && i + 1 < argc)
+            {
+                pipelineArgs.push_back(argv[++i]);
+            }
+        }
+        else
+        {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    try
+    {
+        applyCommandLine((int)pipelineArgs.size(), pipelineArgs.data(), defaults);
+    }
+    catch (const exception &e)
+    {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    vector<SequenceJob> jobs;
+    try
+    {
+        jobs = readManifest(manifestFile, defaults);
+    }
+    catch (const exception &e)
+    {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    if (jobs.empty())
+    {
+        cerr << "no sequences in " << manifestFile << endl;
+        return 1;
+    }
+
+    // cv::setNumThreads is process-wide: split the cores between the workers and OpenCV's own parallel loops
+    // (tiled detection, cv::parallel_for_ inside the detectors) so that the two together do not oversubscribe
+    if (numWorkers == 0)
+    {
+        numWorkers = min(numCores, (int)jobs.size());
+    }
+    int cvThreads = max(1, numCores / numWorkers);
+    cv::setNumThreads(cvThreads);
+    cerr << "Processing " << jobs.size() << " sequences on " << numWorkers << " workers with "
+         << cvThreads << " OpenCV threads each" << endl;
+
+    vector<SequenceResult> results(jobs.size());
+    mutex logMtx;
+    double t = (double)cv::getTickCount();
+    {
+        WorkStealingPool pool(numWorkers);
+        for (size_t i = 0; i < jobs.size(); ++i)
+        {
+            pool.submit([&, i]() {
+                results[i] = processSequence(jobs[i]);
+                const SequenceResult &r = results[i];
+                lock_guard<mutex> lock(logMtx);
+                cerr << r.name << ": "
+                     << (r.error.empty() ? to_string(r.frames) + " frames in " + to_string(r.seconds) + " s" : "FAILED (" + r.error + ")")
+                     << endl;
+            });
+        }
+        pool.wait();
+    }
+    double wallSeconds = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+
+    ofstream os(outFile);
+    if (!os)
+    {
+        cerr << "could not open " << outFile << " for writing" << endl;
+        return 1;
+    }
+    os << fixed << setprecision(3);
+    os << "sequence,frames,seconds,fps,keypoints_per_frame,matches_per_frame,error" << endl;
+    size_t totalFrames = 0, failed = 0;
+    for (auto it = results.begin(); it != results.end(); ++it)
+    {
+        double fps = it->seconds > 0.0 ? it->frames / it->seconds : 0.0;
+        os << csvEscape(it->name) << "," << it->frames << "," << it->seconds << "," << fps << "," << it->keypointsPerFrame << ","
+           << it->matchesPerFrame << "," << csvEscape(it->error) << endl;
+        totalFrames += it->frames;
+        failed += it->error.empty() ? 0 : 1;
+    }
+
+    cout << fixed << setprecision(2);
+    cout << "Processed " << totalFrames << " frames of " << results.size() - failed << " sequences (" << failed << " failed) in "
+         << wallSeconds << " s, aggregate " << (wallSeconds > 0.0 ? totalFrames / wallSeconds : 0.0) << " fps" << endl;
+    cout << "Per-sequence results written to " << outFile << endl;
+
+    return failed == 0 ? 0 : 2;
+}
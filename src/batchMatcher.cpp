@@ -0,0 +1,135 @@
+#include <limits>
+#include <climits>
+#include <stdexcept>
+
+#include "batchMatcher.hpp"
+#include "hammingMatcher.hpp"
+
+using namespace std;
+
+// Best and second best row in [begin, end) for one query row. dist(j, bound) returns the distance between the
+// query and row j, or any value >= bound once it is known to be at least that large.
+template <typename DistFn>
+static void searchTwoBest(int begin, int end, bool bKnn, DistFn dist, int &bestIdx, float &best, float &second)
+{
+    best = second = numeric_limits<float>::max();
+    bestIdx = -1;
+    for (int j = begin; j < end; ++j)
+    {
+        float d = dist(j, bKnn ? second : best);
+        if (d < best)
+        {
+            second = best;
+            best = d;
+            bestIdx = j;
+        }
+        else if (d < second)
+        {
+            second = d;
+        }
+    }
+}
+
+// Every stacked reference row is a query against the current frame's rows, as the reference frame's descriptors are
+// the query of the pairwise matcher. dist(s, i, bound) is the distance between stacked row s and current row i.
+// With bCrossCheck, a match is only kept if its current row finds the same reference row as its nearest neighbour
+// within that reference frame.
+template <typename DistFn>
+static void scanFrames(int numCurr, const vector<int> &offsets, bool bKnn, bool bCrossCheck, float ratio, DistFn dist,
+                       vector<vector<cv::DMatch>> &matches)
+{
+    const float inf = numeric_limits<float>::max();
+    int numFrames = (int)offsets.size() - 1;
+
+    // nearest stacked row per frame and current row, only needed for the cross-check
+    thread_local vector<int> reverse; // storage is reused from frame to frame
+    reverse.assign(bCrossCheck ? (size_t)numFrames * numCurr : 0, -1);
+    for (int i = 0; bCrossCheck && i < numCurr; ++i)
+    {
+        for (int f = 0; f < numFrames; ++f)
+        {
+            int bestIdx;
+            float best, second;
+            searchTwoBest(offsets[f], offsets[f + 1], false, [&](int s, float bound) { return dist(s, i, bound); },
+                          bestIdx, best, second);
+            reverse[(size_t)f * numCurr + i] = bestIdx;
+        }
+    }
+
+    // the current frame's rows stay hot in cache while the stacked reference rows of all frames sweep over them
+    for (int f = 0; f < numFrames; ++f)
+    {
+        for (int s = offsets[f]; s < offsets[f + 1]; ++s)
+        {
+            int bestIdx;
+            float best, second;
+            searchTwoBest(0, numCurr, bKnn, [&](int i, float bound) { return dist(s, i, bound); }, bestIdx, best, second);
+
+            // the ratio test is undefined for a current frame with a single candidate
+            if (bestIdx < 0 || (bKnn && !(second < inf && best < ratio * second)))
+            {
+                continue;
+            }
+            if (bCrossCheck && reverse[(size_t)f * numCurr + bestIdx] != s)
+            {
+                continue;
+            }
+            matches[f].push_back(cv::DMatch(s - offsets[f], bestIdx, best));
+        }
+    }
+}
+
+void matchDescriptorsBatched(const cv::Mat &descCurr, const vector<const cv::Mat *> &descRefs, cv::Mat &stacked,
+                             vector<vector<cv::DMatch>> &matches, const string &selectorType, float ratio, bool bCrossCheck)
+{
+    int numFrames = (int)descRefs.size();
+    matches.resize(numFrames);
+    for (auto it = matches.begin(); it != matches.end(); ++it)
+    {
+        it->clear();
+    }
+
+    // row offsets of the reference frames within the stacked matrix
+    vector<int> offsets(numFrames + 1, 0);
+    for (int f = 0; f < numFrames; ++f)
+    {
+        const cv::Mat &ref = *descRefs[f];
+        if (!ref.empty() && (ref.cols != descCurr.cols || ref.type() != descCurr.type()))
+        {
+            throw invalid_argument("matchDescriptorsBatched: reference descriptors differ in size or type");
+        }
+        offsets[f + 1] = offsets[f] + ref.rows;
+    }
+    if (descCurr.empty() || offsets.back() == 0)
+    {
+        return;
+    }
+
+    stacked.create(offsets.back(), descCurr.cols, descCurr.type());
+    for (int f = 0; f < numFrames; ++f)
+    {
+        if (offsets[f + 1] > offsets[f])
+        {
+            cv::Mat dst = stacked.rowRange(offsets[f], offsets[f + 1]);
+            descRefs[f]->copyTo(dst);
+        }
+    }
+
+    bool bKnn = selectorType.compare("SEL_KNN") == 0;
+    if (descCurr.type() == CV_8U)
+    {
+        int len = descCurr.cols;
+        scanFrames(descCurr.rows, offsets, bKnn, bCrossCheck, ratio, [&](int s, int i, float bound) {
+            int intBound = bound < (float)INT_MAX ? (int)bound : INT_MAX;
+            return (float)hammingDistance(stacked.ptr<uchar>(s), descCurr.ptr<uchar>(i), len, intBound);
+        }, matches);
+    }
+    else
+    {
+        cv::Mat dist;
+        cv::batchDistance(stacked, descCurr, dist, CV_32F, cv::noArray(), cv::NORM_L2);
+        scanFrames(descCurr.rows, offsets, bKnn, bCrossCheck, ratio, [&](int s, int i, float) {
+            return dist.ptr<float>(s)[i];
+        }, matches);
+    }
+}
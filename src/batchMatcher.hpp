@@ -0,0 +1,22 @@
+#ifndef batchMatcher_hpp
+#define batchMatcher_hpp
+
+#include <vector>
+#include <string>
+#include <opencv2/core.hpp>
+
+
+// Match several reference frames against the current frame's descriptors in a single pass. The reference
+// descriptors are stacked into one matrix (kept in `stacked` so its storage is reused), and every stacked row looks
+// up its two nearest neighbours among the current frame's rows, which stay in cache for all reference frames.
+// As in the pairwise matcher, the reference frame is the query side: SEL_NN keeps the nearest current row of every
+// reference row, SEL_KNN applies the ratio test to it, bCrossCheck only keeps mutual nearest neighbours. So
+// matches[0] is what matchDescriptors gives for the previous frame with an exhaustive matcher.
+// matches[f] holds the matches with descRefs[f]: queryIdx indexes the reference frame's keypoints and trainIdx the
+// current frame's, i.e. the layout of DataFrame::kptMatches. Binary (CV_8U) descriptors use the popcount Hamming
+// kernel, CV_32F descriptors one cv::batchDistance call with L2.
+void matchDescriptorsBatched(const cv::Mat &descCurr, const std::vector<const cv::Mat *> &descRefs, cv::Mat &stacked,
+                             std::vector<std::vector<cv::DMatch>> &matches, const std::string &selectorType, float ratio,
+                             bool bCrossCheck = false);
+
+#endif /* batchMatcher_hpp */
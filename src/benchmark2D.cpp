@@ -0,0 +1,480 @@
+/* BENCHMARK OVER ALL DETECTOR / DESCRIPTOR / MATCHER COMBINATIONS */
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <memory>
+#include <string>
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+#include <cstdlib>
+#include <new>
+#include <atomic>
+#include <opencv2/core.hpp>
+
+#include "dataStructures.h"
+#include "ringBuffer.h"
+#include "matching2D.hpp"
+#include "pipeline.hpp"
+#include "instrumentation.hpp"
+#include "hammingMatcher.hpp"
+#include "featureCache.hpp"
+#include "matPool.hpp"
+
+using namespace std;
+
+// Every operator new of the process is counted, so the benchmark can show how many heap allocations a
+// steady-state frame still makes (std containers here and inside OpenCV; Mat buffers are counted by the pool)
+static atomic<size_t> heapAllocations(0);
+
+void *operator new(size_t size)
+{
+    ++heapAllocations;
+    void *p = malloc(size > 0 ? size : 1);
+    if (!p)
+    {
+        throw bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+struct LatencySummary { // per-stage latency in ms
+    double mean = 0.0, p50 = 0.0, p99 = 0.0;
+};
+
+struct BenchmarkResult { // result of all timed runs for one combination
+    string detectorType, descriptorType, matcherType, selectorType, backend;
+    string error; // set if the combination failed
+    LatencySummary detect, describe, match, frame;
+    LatencySummary transfer; // host <-> device copies per frame, already included in the stage latencies
+    LatencySummary cache;    // feature cache lookups (and stores after a miss) per frame, not part of detect / describe
+    double cacheHitRate = 0.0; // share of the frames whose features came from the cache
+    double keypointsPerFrame = 0.0;
+    double matchesPerFrame = 0.0;
+    double heapAllocsPerFrame = 0.0; // operator new calls
+    double matAllocsPerFrame = 0.0;  // Mat buffers which did not come from the pool
+    double fps = 0.0;
+};
+
+struct FrameSample { // measurements for one processed frame
+    double detectMs, describeMs, matchMs;
+    double transferMs; // part of the above spent copying between host and device
+    double cacheMs;    // feature cache lookup and store
+    bool bCacheHit;    // features loaded from the cache, neither detected nor described
+    size_t keypoints, matches;
+    size_t heapAllocs, matAllocs; // allocations while processing the frame
+};
+
+static LatencySummary summarize(vector<double> values)
+{
+    LatencySummary s;
+    if (values.empty())
+    {
+        return s;
+    }
+    sort(values.begin(), values.end());
+    for (auto it = values.begin(); it != values.end(); ++it)
+    {
+        s.mean += *it;
+    }
+    s.mean /= values.size();
+
+    // nearest-rank percentiles
+    auto percentile = [&values](double p) {
+        size_t rank = (size_t)ceil(p * values.size());
+        return values[rank > 0 ? rank - 1 : 0];
+    };
+    s.p50 = percentile(0.50);
+    s.p99 = percentile(0.99);
+    return s;
+}
+
+static double elapsedMs(double t)
+{
+    return 1000 * ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+}
+
+// Run all frames of the (already decoded) sequence once through detection, description and matching
+static void runSequence(const PipelineConfig &cfg, PipelineContext &ctx, const vector<cv::Mat> &images, vector<FrameSample> *samples)
+{
+    RingBuffer<DataFrame> dataBuffer(cfg.dataBufferSize);
+    ctx.predictedMotion = cv::Point2f(0.0f, 0.0f); // every run starts without motion prediction
+    for (size_t imgIndex = 0; imgIndex < images.size(); ++imgIndex)
+    {
+        DataFrame &frame = dataBuffer.push();
+        frame.frameIndex = imgIndex;
+        frame.cameraImg = images[imgIndex];
+        frame.keypoints.clear();
+        frame.kptMatches.clear();
+        frame.bPyramidValid = false;
+        frame.descIndex.reset();
+        releaseCachedFeatures(frame);
+
+        FrameSample sample;
+        ctx.transferMs = 0.0;
+        size_t heapBefore = heapAllocations, matBefore = matPoolStats().misses;
+        bool bCache = !cfg.featureCacheDir.empty();
+        double t = (double)cv::getTickCount();
+        sample.bCacheHit = bCache && loadCachedFeatures(cfg, frame);
+        sample.cacheMs = bCache ? elapsedMs(t) : 0.0;
+        sample.detectMs = 0.0;
+        sample.describeMs = 0.0;
+        if (!sample.bCacheHit)
+        {
+            t = (double)cv::getTickCount();
+            detectKeypoints(cfg, ctx, frame, false);
+            sample.detectMs = elapsedMs(t);
+
+            t = (double)cv::getTickCount();
+            describeKeypoints(ctx, frame);
+            sample.describeMs = elapsedMs(t);
+
+            if (bCache)
+            {
+                t = (double)cv::getTickCount();
+                storeCachedFeatures(cfg, frame);
+                sample.cacheMs += elapsedMs(t);
+            }
+        }
+
+        sample.matchMs = 0.0;
+        if (dataBuffer.size() > 1)
+        {
+            t = (double)cv::getTickCount();
+            matchFrames(ctx, dataBuffer.previous(), frame);
+            sample.matchMs = elapsedMs(t);
+        }
+        sample.transferMs = ctx.transferMs;
+        sample.keypoints = frame.keypoints.size();
+        sample.matches = frame.kptMatches.size();
+        sample.heapAllocs = heapAllocations - heapBefore;
+        sample.matAllocs = matPoolStats().misses - matBefore;
+        matPoolEndFrame();
+
+        if (samples)
+        {
+            samples->push_back(sample);
+        }
+    }
+}
+
+static BenchmarkResult benchmarkCombination(const PipelineConfig &cfg, const vector<cv::Mat> &images, int warmupRuns, int timedRuns)
+{
+    BenchmarkResult result;
+    result.detectorType = cfg.detectorType;
+    result.descriptorType = cfg.descriptorType;
+    result.matcherType = cfg.matcherType;
+    result.selectorType = cfg.selectorType;
+    result.backend = cfg.backend;
+
+    try
+    {
+        PipelineContext ctx;
+        initPipelineContext(ctx, cfg);
+
+        for (int run = 0; run < warmupRuns; ++run)
+        {
+            runSequence(cfg, ctx, images, nullptr);
+        }
+
+        vector<FrameSample> samples;
+        double t = (double)cv::getTickCount();
+        for (int run = 0; run < timedRuns; ++run)
+        {
+            runSequence(cfg, ctx, images, &samples);
+        }
+        double totalMs = elapsedMs(t);
+
+        vector<double> detectMs, describeMs, matchMs, frameMs, transferMs, cacheMs;
+        size_t keypoints = 0, matches = 0, matchedFrames = 0, heapAllocs = 0, matAllocs = 0, cacheHits = 0;
+        for (auto it = samples.begin(); it != samples.end(); ++it)
+        {
+            // cache hits would otherwise show up as an impossibly fast detector
+            if (!it->bCacheHit)
+            {
+                detectMs.push_back(it->detectMs);
+                describeMs.push_back(it->describeMs);
+            }
+            if (!cfg.featureCacheDir.empty())
+            {
+                cacheMs.push_back(it->cacheMs);
+                cacheHits += it->bCacheHit;
+            }
+            frameMs.push_back(it->detectMs + it->describeMs + it->cacheMs + it->matchMs);
+            transferMs.push_back(it->transferMs);
+            keypoints += it->keypoints;
+            heapAllocs += it->heapAllocs;
+            matAllocs += it->matAllocs;
+            if (it->matchMs > 0.0)
+            {
+                matchMs.push_back(it->matchMs);
+                matches += it->matches;
+                ++matchedFrames;
+            }
+        }
+        result.detect = summarize(detectMs);
+        result.describe = summarize(describeMs);
+        result.match = summarize(matchMs);
+        result.frame = summarize(frameMs);
+        result.transfer = summarize(transferMs);
+        result.cache = summarize(cacheMs);
+        result.cacheHitRate = samples.empty() ? 0.0 : (double)cacheHits / samples.size();
+        result.keypointsPerFrame = samples.empty() ? 0.0 : (double)keypoints / samples.size();
+        result.matchesPerFrame = matchedFrames == 0 ? 0.0 : (double)matches / matchedFrames;
+        result.heapAllocsPerFrame = samples.empty() ? 0.0 : (double)heapAllocs / samples.size();
+        result.matAllocsPerFrame = samples.empty() ? 0.0 : (double)matAllocs / samples.size();
+        result.fps = totalMs > 0.0 ? 1000.0 * samples.size() / totalMs : 0.0;
+    }
+    catch (const exception &e)
+    {
+        result.error = e.what();
+    }
+    return result;
+}
+
+// Descriptor / detector pairs which OpenCV cannot process
+static bool isValidCombination(const string &detectorType, const string &descriptorType)
+{
+    // AKAZE descriptors need the scale-space information stored in AKAZE keypoints
+    return descriptorType.compare("AKAZE") != 0 || detectorType.compare("AKAZE") == 0;
+}
+
+static string csvEscape(const string &str)
+{
+    string out = "\"";
+    for (auto it = str.begin(); it != str.end(); ++it)
+    {
+        out += (*it == '"') ? "\"\"" : string(1, *it == '\n' ? ' ' : *it);
+    }
+    return out + "\"";
+}
+
+static string jsonEscape(const string &str)
+{
+    string out;
+    for (auto it = str.begin(); it != str.end(); ++it)
+    {
+        if (*it == '"' || *it == '\\')
+        {
+            out += '\\';
+        }
+        out += (*it == '\n') ? ' ' : *it;
+    }
+    return out;
+}
+
+static void writeCsv(ostream &os, const vector<BenchmarkResult> &results)
+{
+    os << "detector,descriptor,matcher,selector,backend,"
+       << "detect_mean_ms,detect_p50_ms,detect_p99_ms,"
+       << "describe_mean_ms,describe_p50_ms,describe_p99_ms,"
+       << "match_mean_ms,match_p50_ms,match_p99_ms,"
+       << "frame_mean_ms,frame_p50_ms,frame_p99_ms,"
+       << "transfer_mean_ms,transfer_p50_ms,transfer_p99_ms,"
+       << "cache_mean_ms,cache_p50_ms,cache_p99_ms,cache_hit_rate,"
+       << "keypoints_per_frame,matches_per_frame,heap_allocs_per_frame,mat_allocs_per_frame,fps,error" << endl;
+
+    for (auto it = results.begin(); it != results.end(); ++it)
+    {
+        const LatencySummary *stages[] = {&it->detect, &it->describe, &it->match, &it->frame, &it->transfer, &it->cache};
+        os << it->detectorType << "," << it->descriptorType << "," << it->matcherType << "," << it->selectorType << "," << it->backend;
+        for (int i = 0; i < 6; ++i)
+        {
+            os << "," << stages[i]->mean << "," << stages[i]->p50 << "," << stages[i]->p99;
+        }
+        os << "," << it->cacheHitRate << "," << it->keypointsPerFrame << "," << it->matchesPerFrame << "," << it->heapAllocsPerFrame << "," << it->matAllocsPerFrame
+           << "," << it->fps << "," << csvEscape(it->error) << endl;
+    }
+}
+
+static void writeJsonLatency(ostream &os, const char *name, const LatencySummary &s)
+{
+    os << "\"" << name << "\": {\"mean_ms\": " << s.mean << ", \"p50_ms\": " << s.p50 << ", \"p99_ms\": " << s.p99 << "}";
+}
+
+static void writeJson(ostream &os, const vector<BenchmarkResult> &results)
+{
+    os << "[" << endl;
+    for (auto it = results.begin(); it != results.end(); ++it)
+    {
+        os << "  {\"detector\": \"" << it->detectorType << "\", \"descriptor\": \"" << it->descriptorType
+           << "\", \"matcher\": \"" << it->matcherType << "\", \"selector\": \"" << it->selectorType
+           << "\", \"backend\": \"" << it->backend << "\", ";
+        writeJsonLatency(os, "detect", it->detect);
+        os << ", ";
+        writeJsonLatency(os, "describe", it->describe);
+        os << ", ";
+        writeJsonLatency(os, "match", it->match);
+        os << ", ";
+        writeJsonLatency(os, "frame", it->frame);
+        os << ", ";
+        writeJsonLatency(os, "transfer", it->transfer);
+        os << ", ";
+        writeJsonLatency(os, "cache", it->cache);
+        os << ", \"cache_hit_rate\": " << it->cacheHitRate << ", \"keypoints_per_frame\": " << it->keypointsPerFrame << ", \"matches_per_frame\": " << it->matchesPerFrame
+           << ", \"heap_allocs_per_frame\": " << it->heapAllocsPerFrame << ", \"mat_allocs_per_frame\": " << it->matAllocsPerFrame
+           << ", \"fps\": " << it->fps << ", \"error\": \"" << jsonEscape(it->error) << "\"}"
+           << (it + 1 != results.end() ? "," : "") << endl;
+    }
+    os << "]" << endl;
+}
+
+static void printUsage(const char *name)
+{
+    cout << "Usage: " << name << " [--runs N] [--warmup N] [--format csv|json] [--out FILE] [--trace FILE] [--gated RADIUS] [--cache DIR] [--backend CPU|OPENCL] [--no-mat-pool]" << endl;
+}
+
+/* MAIN PROGRAM */
+int main(int argc, const char *argv[])
+{
+    PipelineConfig cfg;
+    int timedRuns = 5;
+    int warmupRuns = 1;
+    string format = "csv";
+    string outFile = "benchmark.csv";
+    bool bOutFileSet = false;
+    string traceFile = ""; // Chrome trace of all runs
+    float gateRadius = 0.0f; // > 0 -> use spatially gated matching with this radius
+    string backend = "CPU";  // CPU or OPENCL
+    string cacheDir = "";    // feature cache directory, after the first run matchers are benchmarked at I/O speed
+
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (arg == "--runs" && i + 1 < argc)
+        {
+            timedRuns = max(1, atoi(argv[++i]));
+        }
+        else if (arg == "--warmup" && i + 1 < argc)
+        {
+            warmupRuns = max(0, atoi(argv[++i]));
+        }
+        else if (arg == "--format" && i + 1 < argc)
+        {
+            format = argv[++i];
+        }
+        else if (arg == "--out" && i + 1 < argc)
+        {
+            outFile = argv[++i];
+            bOutFileSet = true;
+        }
+        else if (arg == "--trace" && i + 1 < argc)
+        {
+            traceFile = argv[++i];
+        }
+        else if (arg == "--gated" && i + 1 < argc)
+        {
+            gateRadius = (float)atof(argv[++i]);
+        }
+        else if (arg == "--cache" && i + 1 < argc)
+        {
+            cacheDir = argv[++i];
+        }
+        else if (arg == "--backend" && i + 1 < argc)
+        {
+            backend = argv[++i];
+        }
+        else if (arg == "--no-mat-pool")
+        {
+            cfg.bPoolMats = false; // Mat buffers are only counted, not reused
+        }
+        else
+        {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (format != "csv" && format != "json")
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+    if (!bOutFileSet)
+    {
+        outFile = "benchmark." + format;
+    }
+
+    cfg.imgBasePath = "../images/";
+    setInstrumentationEnabled(!traceFile.empty());
+    enableMatPool(cfg.bPoolMats);
+    cfg.bGatedMatching = gateRadius > 0.0f;
+    cfg.gateRadius = gateRadius;
+    cfg.featureCacheDir = cacheDir;
+    cfg.backend = backend;
+
+    // decode the sequence once, so that file I/O is not part of the measurements
+    vector<cv::Mat> images;
+    unique_ptr<FrameSource> source = createFrameSource(cfg);
+    cv::Mat img;
+    while (source->read(img))
+    {
+        images.push_back(img.clone()); // own copy, frames of some sources point into memory the source owns
+    }
+
+    // everything detKeypoints*, descKeypoints and matchDescriptors currently support
+    vector<string> detectorTypes = {"SHITOMASI", "HARRIS", "FAST", "BRISK", "ORB", "AKAZE"};
+    vector<string> descriptorTypes = {"BRISK", "ORB", "AKAZE"};
+    vector<string> matcherTypes = {"MAT_BF", "MAT_FLANN", "MAT_HAMMING"}; // MAT_HAMMING vs. cv::BFMatcher
+    vector<string> selectorTypes = {"SEL_NN", "SEL_KNN"};
+
+    vector<BenchmarkResult> results;
+    for (auto det = detectorTypes.begin(); det != detectorTypes.end(); ++det)
+    {
+        for (auto desc = descriptorTypes.begin(); desc != descriptorTypes.end(); ++desc)
+        {
+            if (!isValidCombination(*det, *desc))
+            {
+                continue;
+            }
+            for (auto mat = matcherTypes.begin(); mat != matcherTypes.end(); ++mat)
+            {
+                for (auto sel = selectorTypes.begin(); sel != selectorTypes.end(); ++sel)
+                {
+                    cfg.detectorType = *det;
+                    cfg.descriptorType = *desc;
+                    cfg.matcherType = *mat;
+                    cfg.descriptorClass = "DES_BINARY"; // all supported descriptors are binary
+                    cfg.selectorType = *sel;
+
+                    results.push_back(benchmarkCombination(cfg, images, warmupRuns, timedRuns));
+                    const BenchmarkResult &r = results.back();
+                    cerr << r.detectorType << " + " << r.descriptorType << " + " << r.matcherType << " + " << r.selectorType << ": "
+                         << (r.error.empty() ? to_string(r.fps) + " fps" : "FAILED (" + r.error + ")") << endl;
+                }
+            }
+        }
+    }
+
+    ofstream os(outFile);
+    if (!os)
+    {
+        cerr << "could not open " << outFile << " for writing" << endl;
+        return 1;
+    }
+    os << fixed << setprecision(3);
+    if (format == "json")
+    {
+        writeJson(os, results);
+    }
+    else
+    {
+        writeCsv(os, results);
+    }
+    cerr << "MAT_HAMMING kernel: " << hammingKernelName() << endl;
+    cerr << "Results for " << results.size() << " combinations written to " << outFile << endl;
+
+    if (!traceFile.empty())
+    {
+        ofstream trace(traceFile);
+        writeChromeTrace(trace);
+    }
+
+    return 0;
+}
@@ -0,0 +1,64 @@
+#ifndef boundedQueue_h
+#define boundedQueue_h
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <cstddef>
+
+
+// Blocking FIFO queue with a fixed maximum size, used to hand frames between pipeline stage threads.
+// close() wakes up all waiting threads: push() then fails and pop() drains the remaining elements.
+template <typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(std::size_t maxSize) : maxSize(maxSize > 0 ? maxSize : 1), closed(false) {}
+
+    // blocks while the queue is full, returns false if the queue has been closed
+    bool push(T &&item)
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        notFull.wait(lock, [this]() { return closed || items.size() < maxSize; });
+        if (closed)
+        {
+            return false;
+        }
+        items.push_back(std::move(item));
+        notEmpty.notify_one();
+        return true;
+    }
+
+    // blocks while the queue is empty, returns false once the queue is closed and drained
+    bool pop(T &item)
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        notEmpty.wait(lock, [this]() { return closed || !items.empty(); });
+        if (items.empty())
+        {
+            return false;
+        }
+        item = std::move(items.front());
+        items.pop_front();
+        notFull.notify_one();
+        return true;
+    }
+
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        closed = true;
+        notFull.notify_all();
+        notEmpty.notify_all();
+    }
+
+private:
+    std::deque<T> items;
+    std::size_t maxSize;
+    bool closed;
+    std::mutex mtx;
+    std::condition_variable notFull, notEmpty;
+};
+
+
+#endif /* boundedQueue_h */
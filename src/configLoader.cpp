@@ -0,0 +1,382 @@
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <functional>
+#include <stdexcept>
+
+#include "configLoader.hpp"
+#include "matching2D.hpp"
+
+using namespace std;
+
+static string trim(const string &s)
+{
+    size_t first = s.find_first_not_of(" \t\r\n");
+    if (first == string::npos)
+    {
+        return "";
+    }
+    size_t last = s.find_last_not_of(" \t\r\n");
+    return s.substr(first, last - first + 1);
+}
+
+// Parse value into the member type, throws std::invalid_argument if it does not fit
+static void parseValue(const string &value, string &out)
+{
+    if (value.size() >= 2 && value.front() == '"' && value.back() == '"')
+    {
+        out = value.substr(1, value.size() - 2);
+    }
+    else
+    {
+        out = value;
+    }
+}
+
+static void parseValue(const string &value, int &out)
+{
+    size_t pos = 0;
+    out = stoi(value, &pos);
+    if (pos != value.size())
+    {
+        throw invalid_argument("not an integer");
+    }
+}
+
+static void parseValue(const string &value, float &out)
+{
+    size_t pos = 0;
+    out = stof(value, &pos);
+    if (pos != value.size())
+    {
+        throw invalid_argument("not a number");
+    }
+}
+
+static void parseValue(const string &value, bool &out)
+{
+    if (value.compare("true") == 0 || value.compare("1") == 0)
+    {
+        out = true;
+    }
+    else if (value.compare("false") == 0 || value.compare("0") == 0)
+    {
+        out = false;
+    }
+    else
+    {
+        throw invalid_argument("not a boolean");
+    }
+}
+
+// integers separated by sep, e.g. 4x2 or 535,180,180,150
+static vector<int> parseInts(const string &value, char sep)
+{
+    vector<int> ints;
+    stringstream ss(value);
+    string item;
+    while (getline(ss, item, sep))
+    {
+        int v;
+        parseValue(trim(item), v);
+        ints.push_back(v);
+    }
+    return ints;
+}
+
+static void parseValue(const string &value, cv::Size &out)
+{
+    vector<int> ints = parseInts(value, 'x');
+    if (ints.size() != 2)
+    {
+        throw invalid_argument("not a size (width x height)");
+    }
+    out = cv::Size(ints[0], ints[1]);
+}
+
+static void parseValue(const string &value, cv::Rect &out)
+{
+    vector<int> ints = parseInts(value, ',');
+    if (ints.size() != 4)
+    {
+        throw invalid_argument("not a rectangle (x,y,width,height)");
+    }
+    out = cv::Rect(ints[0], ints[1], ints[2], ints[3]);
+}
+
+static string formatValue(const string &v) { return "\"" + v + "\""; }
+static string formatValue(int v) { return to_string(v); }
+static string formatValue(bool v) { return v ? "true" : "false"; }
+static string formatValue(const cv::Size &v) { return to_string(v.width) + "x" + to_string(v.height); }
+
+static string formatValue(float v)
+{
+    ostringstream os;
+    os << v;
+    return os.str();
+}
+
+static string formatValue(const cv::Rect &v)
+{
+    return to_string(v.x) + "," + to_string(v.y) + "," + to_string(v.width) + "," + to_string(v.height);
+}
+
+struct ConfigField {
+    const char *key;
+    function<void(PipelineConfig &, const string &)> set;
+    function<string(const PipelineConfig &)> get;
+};
+
+template <typename T>
+static ConfigField field(const char *key, T PipelineConfig::*member)
+{
+    return ConfigField{key,
+                       [member](PipelineConfig &cfg, const string &value) { parseValue(value, cfg.*member); },
+                       [member](const PipelineConfig &cfg) { return formatValue(cfg.*member); }};
+}
+
+// all members of PipelineConfig, in declaration order
+static const vector<ConfigField> &configFields()
+{
+    static const vector<ConfigField> fields = {
+        field("sourceType", &PipelineConfig::sourceType),
+        field("sourceUri", &PipelineConfig::sourceUri),
+        field("rawFrameSize", &PipelineConfig::rawFrameSize),
+        field("imgBasePath", &PipelineConfig::imgBasePath),
+        field("imgPrefix", &PipelineConfig::imgPrefix),
+        field("imgFileType", &PipelineConfig::imgFileType),
+        field("imgStartIndex", &PipelineConfig::imgStartIndex),
+        field("imgEndIndex", &PipelineConfig::imgEndIndex),
+        field("imgFillWidth", &PipelineConfig::imgFillWidth),
+        field("dataBufferSize", &PipelineConfig::dataBufferSize),
+        field("detectorType", &PipelineConfig::detectorType),
+        field("descriptorType", &PipelineConfig::descriptorType),
+        field("matcherType", &PipelineConfig::matcherType),
+        field("descriptorClass", &PipelineConfig::descriptorClass),
+        field("selectorType", &PipelineConfig::selectorType),
+        field("thresholdFAST", &PipelineConfig::thresholdFAST),
+        field("harrisMinResponse", &PipelineConfig::harrisMinResponse),
+        field("shiTomasiQualityLevel", &PipelineConfig::shiTomasiQualityLevel),
+        field("minDescDistRatio", &PipelineConfig::minDescDistRatio),
+        field("bCrossCheck", &PipelineConfig::bCrossCheck),
+        field("matchHistory", &PipelineConfig::matchHistory),
+        field("bGatedMatching", &PipelineConfig::bGatedMatching),
+        field("gateRadius", &PipelineConfig::gateRadius),
+        field("bPredictMotion", &PipelineConfig::bPredictMotion),
+        field("bGridNMS", &PipelineConfig::bGridNMS),
+        field("bFusedHarris", &PipelineConfig::bFusedHarris),
+        field("bFocusOnVehicle", &PipelineConfig::bFocusOnVehicle),
+        field("vehicleRect", &PipelineConfig::vehicleRect),
+        field("bDetectInRoi", &PipelineConfig::bDetectInRoi),
+        field("bLimitKpts", &PipelineConfig::bLimitKpts),
+        field("maxKeypoints", &PipelineConfig::maxKeypoints),
+        field("bAnms", &PipelineConfig::bAnms),
+        field("bTiledDetection", &PipelineConfig::bTiledDetection),
+        field("tileGrid", &PipelineConfig::tileGrid),
+        field("bDetectAndCompute", &PipelineConfig::bDetectAndCompute),
+        field("bAdaptiveBudget", &PipelineConfig::bAdaptiveBudget),
+        field("frameDeadlineMs", &PipelineConfig::frameDeadlineMs),
+        field("minKeypointBudget", &PipelineConfig::minKeypointBudget),
+        field("maxKeypointBudget", &PipelineConfig::maxKeypointBudget),
+        field("bVisKeypoints", &PipelineConfig::bVisKeypoints),
+        field("bKltTracking", &PipelineConfig::bKltTracking),
+        field("redetectInterval", &PipelineConfig::redetectInterval),
+        field("minTrackedKeypoints", &PipelineConfig::minTrackedKeypoints),
+        field("kltWinSize", &PipelineConfig::kltWinSize),
+        field("kltMaxLevel", &PipelineConfig::kltMaxLevel),
+        field("visSink", &PipelineConfig::visSink),
+        field("visPath", &PipelineConfig::visPath),
+        field("visFps", &PipelineConfig::visFps),
+        field("visQueueSize", &PipelineConfig::visQueueSize),
+        field("featureCacheDir", &PipelineConfig::featureCacheDir),
+        field("backend", &PipelineConfig::backend),
+        field("bPipelined", &PipelineConfig::bPipelined),
+        field("queueSize", &PipelineConfig::queueSize),
+        field("prefetchSize", &PipelineConfig::prefetchSize),
+        field("prefetchThreads", &PipelineConfig::prefetchThreads),
+        field("bPoolMats", &PipelineConfig::bPoolMats),
+        field("bLogStages", &PipelineConfig::bLogStages),
+        field("bInstrument", &PipelineConfig::bInstrument),
+        field("bStageSummary", &PipelineConfig::bStageSummary),
+        field("traceFile", &PipelineConfig::traceFile),
+    };
+    return fields;
+}
+
+void setConfigValue(PipelineConfig &cfg, const string &key, const string &value)
+{
+    for (auto it = configFields().begin(); it != configFields().end(); ++it)
+    {
+        if (key.compare(it->key) == 0)
+        {
+            try
+            {
+                it->set(cfg, trim(value));
+            }
+            catch (const logic_error &e) // invalid_argument or out_of_range from the parsers
+            {
+                throw invalid_argument("bad value '" + value + "' for " + key + ": " + e.what());
+            }
+            return;
+        }
+    }
+    throw invalid_argument("unknown config key " + key);
+}
+
+void loadConfigFile(const string &filename, PipelineConfig &cfg)
+{
+    ifstream file(filename);
+    if (!file)
+    {
+        throw runtime_error("cannot read config file " + filename);
+    }
+
+    string line;
+    int lineNo = 0;
+    while (getline(file, line))
+    {
+        ++lineNo;
+        // strip the comment, a '#' inside a quoted value belongs to the value
+        bool bQuoted = false;
+        for (size_t i = 0; i < line.size(); ++i)
+        {
+            if (line[i] == '"')
+            {
+                bQuoted = !bQuoted;
+            }
+            else if (line[i] == '#' && !bQuoted)
+            {
+                line.resize(i);
+                break;
+            }
+        }
+        line = trim(line);
+        if (line.empty())
+        {
+            continue;
+        }
+
+        size_t eq = line.find('=');
+        if (eq == string::npos)
+        {
+            throw invalid_argument(filename + ":" + to_string(lineNo) + ": expected key = value");
+        }
+        try
+        {
+            setConfigValue(cfg, trim(line.substr(0, eq)), line.substr(eq + 1));
+        }
+        catch (const invalid_argument &e)
+        {
+            throw invalid_argument(filename + ":" + to_string(lineNo) + ": " + e.what());
+        }
+    }
+}
+
+void applyCommandLine(int argc, const char *argv[], PipelineConfig &cfg)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (arg.compare(0, 2, "--") != 0)
+        {
+            throw invalid_argument("unexpected argument " + arg);
+        }
+
+        string key = arg.substr(2), value;
+        size_t eq = key.find('=');
+        if (eq != string::npos)
+        {
+            value = key.substr(eq + 1);
+            key.resize(eq);
+        }
+        else if (i + 1 < argc)
+        {
+            value = argv[++i];
+        }
+        else
+        {
+            throw invalid_argument("missing value for " + arg);
+        }
+
+        if (key.compare("config") == 0)
+        {
+            loadConfigFile(value, cfg);
+        }
+        else
+        {
+            setConfigValue(cfg, key, value);
+        }
+    }
+}
+
+static void expectOneOf(const string &key, const string &value, const vector<string> &names)
+{
+    for (auto it = names.begin(); it != names.end(); ++it)
+    {
+        if (value.compare(*it) == 0)
+        {
+            return;
+        }
+    }
+    throw invalid_argument("unknown " + key + " " + value);
+}
+
+void validateConfig(const PipelineConfig &cfg)
+{
+    DetectorKind detectorKind = parseDetectorKind(cfg.detectorType);
+    if (detectorKind == DetectorKind::UNKNOWN)
+    {
+        throw invalid_argument("unknown detectorType " + cfg.detectorType);
+    }
+    if (detectorKind != DetectorKind::SHITOMASI && detectorKind != DetectorKind::HARRIS && !createDetector(cfg.detectorType))
+    {
+        throw invalid_argument("detector " + cfg.detectorType + " is not available in this build");
+    }
+    if (!createExtractor(cfg.descriptorType))
+    {
+        throw invalid_argument("descriptor " + cfg.descriptorType + " is unknown or not available in this build");
+    }
+    if (parseMatcherKind(cfg.matcherType) == MatcherKind::UNKNOWN)
+    {
+        throw invalid_argument("unknown matcherType " + cfg.matcherType);
+    }
+    if (parseSelectorKind(cfg.selectorType) == SelectorKind::UNKNOWN)
+    {
+        throw invalid_argument("unknown selectorType " + cfg.selectorType);
+    }
+    expectOneOf("descriptorClass", cfg.descriptorClass, {"DES_BINARY", "DES_HOG"});
+    expectOneOf("sourceType", cfg.sourceType, {"IMAGES", "VIDEO", "RAW"});
+    expectOneOf("backend", cfg.backend, {"CPU", "OPENCL"});
+    expectOneOf("visSink", cfg.visSink, {"NONE", "WINDOW", "VIDEO", "SHM"});
+    if (cfg.bAdaptiveBudget)
+    {
+        if (cfg.frameDeadlineMs <= 0.0f)
+        {
+            throw invalid_argument("frameDeadlineMs must be positive");
+        }
+        if (cfg.minKeypointBudget < 1 || cfg.minKeypointBudget > cfg.maxKeypointBudget)
+        {
+            throw invalid_argument("need 1 <= minKeypointBudget <= maxKeypointBudget");
+        }
+        if (!cfg.featureCacheDir.empty())
+        {
+            throw invalid_argument("bAdaptiveBudget changes the detector settings per frame, it cannot use the feature cache");
+        }
+    }
+    if ((cfg.visSink.compare("VIDEO") == 0 || cfg.visSink.compare("SHM") == 0) && cfg.visPath.empty())
+    {
+        throw invalid_argument("visSink " + cfg.visSink + " needs a visPath");
+    }
+    if (cfg.minDescDistRatio <= 0.0f || cfg.minDescDistRatio > 1.0f)
+    {
+        throw invalid_argument("minDescDistRatio must be in (0, 1]");
+    }
+}
+
+void writeConfig(ostream &os, const PipelineConfig &cfg)
+{
+    for (auto it = configFields().begin(); it != configFields().end(); ++it)
+    {
+        os << it->key << " = " << it->get(cfg) << "\n";
+    }
+}
@@ -0,0 +1,28 @@
+#ifndef configLoader_hpp
+#define configLoader_hpp
+
+#include <string>
+#include <ostream>
+
+#include "pipeline.hpp"
+
+
+// Runtime configuration of the pipeline without a rebuild. Keys are the PipelineConfig member names, values are
+// written as in C++ (true/false, 0.8, "text" or text), cv::Size as 4x2 and cv::Rect as x,y,width,height.
+
+// Set one member of cfg from its textual value, throws std::invalid_argument for unknown keys or malformed values
+void setConfigValue(PipelineConfig &cfg, const std::string &key, const std::string &value);
+
+// Read `key = value` lines ('#' starts a comment), throws std::runtime_error if the file cannot be read
+void loadConfigFile(const std::string &filename, PipelineConfig &cfg);
+
+// Apply `--key value` or `--key=value` options in order, `--config FILE` loads a whole file at that point
+void applyCommandLine(int argc, const char *argv[], PipelineConfig &cfg);
+
+// Reject detector / descriptor / matcher / selector / source / backend names no stage implements
+void validateConfig(const PipelineConfig &cfg);
+
+// One line per key with its current value in cfg, in config file syntax
+void writeConfig(std::ostream &os, const PipelineConfig &cfg);
+
+#endif /* configLoader_hpp */
@@ -2,16 +2,36 @@
 #define dataStructures_h
 
 #include <vector>
+#include <memory>
 #include <opencv2/core.hpp>
 
 
+struct DescriptorIndex; // descriptorIndex.hpp
+
+struct FrameMatches { // keypoint matches between an older frame and the current one
+    std::size_t frameIndex = 0;       // DataFrame::frameIndex of the older frame
+    std::vector<cv::DMatch> matches;  // queryIdx -> keypoints of the older frame, trainIdx -> current frame
+};
+
 struct DataFrame { // represents the available sensor information at the same time instance
     
+    std::size_t frameIndex = 0; // position of the frame within its image sequence
     cv::Mat cameraImg; // camera image
     
     std::vector<cv::KeyPoint> keypoints; // 2D keypoints within camera image
     cv::Mat descriptors; // keypoint descriptors
     std::vector<cv::DMatch> kptMatches; // keypoint matches between previous and current frame
+    std::vector<FrameMatches> historyMatches; // matches with the frames before the previous one (matchHistory > 1)
+
+    std::vector<cv::Mat> pyramid; // optical flow pyramid of cameraImg, built on first use and shared by all trackers
+    bool bPyramidValid = false;   // false -> pyramid is stale (e.g. left over from the frame this slot held before)
+
+    std::shared_ptr<const void> featureStorage; // keeps memory-mapped descriptors of the feature cache alive
+
+    cv::UMat cameraImgDevice;   // camera image on the OpenCL device (OPENCL backend only)
+    cv::UMat descriptorsDevice; // keypoint descriptors on the OpenCL device (OPENCL backend only)
+
+    std::shared_ptr<DescriptorIndex> descIndex; // FLANN index over descriptors (MAT_FLANN only), built on first use
 };
 
 
@@ -0,0 +1,84 @@
+#include <cmath>
+#include <algorithm>
+
+#include "descriptorIndex.hpp"
+#include "instrumentation.hpp"
+
+using namespace std;
+
+DescriptorIndex &descriptorIndex(DataFrame &frame, bool bBinary)
+{
+    const cv::Mat &desc = frame.descriptors;
+    shared_ptr<DescriptorIndex> &idx = frame.descIndex;
+    if (idx && idx->bBinary == bBinary && idx->sourceData == desc.data && idx->sourceRows == desc.rows)
+    {
+        return *idx;
+    }
+
+    ScopedTimer timer("buildDescriptorIndex");
+    idx = make_shared<DescriptorIndex>();
+    idx->bBinary = bBinary;
+    idx->sourceData = desc.data;
+    idx->sourceRows = desc.rows;
+    if (bBinary || desc.type() == CV_32F)
+    {
+        idx->descriptors = desc; // shares the frame's rows
+    }
+    else
+    {
+        desc.convertTo(idx->descriptors, CV_32F); // the KD-tree needs floating point descriptors
+    }
+    if (idx->descriptors.empty())
+    {
+        return *idx; // nothing to index, every search finds no neighbours
+    }
+
+    if (bBinary)
+    {
+        // same LSH parameters as the MAT_FLANN matcher of createMatcher
+        int tableNumber = 12;    // no. of hash tables
+        int keySize = 20;        // length of the hash key in bits
+        int multiProbeLevel = 2; // no. of neighbouring buckets probed per table
+        idx->index.build(idx->descriptors, cv::flann::LshIndexParams(tableNumber, keySize, multiProbeLevel), cvflann::FLANN_DIST_HAMMING);
+    }
+    else
+    {
+        idx->index.build(idx->descriptors, cv::flann::KDTreeIndexParams(), cvflann::FLANN_DIST_L2);
+    }
+    addCounter("descriptor_index_builds", 1);
+    return *idx;
+}
+
+void knnSearchIndex(DescriptorIndex &index, const cv::Mat &query, int k, KnnBuffer &knn)
+{
+    if (query.empty() || index.descriptors.empty())
+    {
+        knn.trainIdx.create(0, k, CV_32S);
+        knn.distance.create(0, k, CV_32F);
+        return;
+    }
+
+    cv::Mat queryRows = query;
+    if (!index.bBinary && query.type() != CV_32F)
+    {
+        query.convertTo(queryRows, CV_32F);
+    }
+    // FLANN leaves the slots of missing neighbours untouched, and the buffers are reused from call to call:
+    // never ask for more neighbours than there are rows, and mark the slots LSH may not fill beforehand
+    k = min(k, index.descriptors.rows);
+    knn.trainIdx.create(queryRows.rows, k, CV_32S);
+    knn.trainIdx.setTo(-1);
+    knn.distScratch.create(queryRows.rows, k, index.bBinary ? CV_32S : CV_32F);
+    knn.distScratch.setTo(0);
+    index.index.knnSearch(queryRows, knn.trainIdx, knn.distScratch, k, cv::flann::SearchParams());
+
+    // LSH reports integer Hamming distances, the KD-tree squared L2 distances (converted as FlannBasedMatcher does)
+    if (index.bBinary)
+    {
+        knn.distScratch.convertTo(knn.distance, CV_32F);
+    }
+    else
+    {
+        cv::sqrt(knn.distScratch, knn.distance);
+    }
+}
@@ -0,0 +1,31 @@
+#ifndef descriptorIndex_hpp
+#define descriptorIndex_hpp
+
+#include <opencv2/core.hpp>
+#include <opencv2/flann.hpp>
+
+#include "dataStructures.h"
+#include "knnMatcher.hpp"
+
+
+// FLANN index over one frame's descriptors: LSH on binary descriptors, KD-tree on CV_32F copies otherwise.
+// It lives in the frame's ring buffer slot, so the index is trained once and reused until the slot is recycled:
+// by the older frames a frame is matched against (matchHistory > 1) and by the cross-check of the next frame.
+struct DescriptorIndex
+{
+    cv::Mat descriptors; // indexed rows, FLANN keeps pointers into them
+    cv::flann::Index index;
+    bool bBinary = true;
+    const uchar *sourceData = nullptr; // DataFrame::descriptors the index was built from
+    int sourceRows = 0;
+};
+
+// Index over frame.descriptors, built on first use; a stale index left over from another frame is rebuilt
+DescriptorIndex &descriptorIndex(DataFrame &frame, bool bBinary);
+
+// k nearest neighbours of every query row into the flat buffer, in the layout of knnMatchFlat
+// (fewer than k columns if the index has fewer than k rows, indices -1 where LSH found fewer neighbours);
+// query rows are converted to CV_32F if needed
+void knnSearchIndex(DescriptorIndex &index, const cv::Mat &query, int k, KnnBuffer &knn);
+
+#endif /* descriptorIndex_hpp */
@@ -0,0 +1,217 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <thread>
+#include <functional>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "featureCache.hpp"
+#include "mappedFile.hpp"
+
+using namespace std;
+
+static_assert(sizeof(cv::KeyPoint) == 7 * 4, "cv::KeyPoint is stored as pt.x, pt.y, size, angle, response, octave, class_id");
+
+static const char featureFileMagic[4] = {'S', 'F', 'F', 'C'};
+static const uint32_t featureFileVersion = 1;
+static const size_t sectionAlignment = 64;
+
+struct FeatureFileHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t imageHash;
+    uint32_t keyLength;    // bytes of the parameter key following the header
+    uint32_t numKeypoints;
+    int32_t descRows, descCols, descType;
+    uint32_t reserved;
+};
+
+static size_t alignSection(size_t offset)
+{
+    return (offset + sectionAlignment - 1) / sectionAlignment * sectionAlignment;
+}
+
+// byte offsets of the keypoint and descriptor sections
+static void sectionOffsets(const FeatureFileHeader &header, size_t &kptOffset, size_t &descOffset)
+{
+    kptOffset = alignSection(sizeof(FeatureFileHeader) + header.keyLength);
+    descOffset = alignSection(kptOffset + (size_t)header.numKeypoints * sizeof(cv::KeyPoint));
+}
+
+static long processId()
+{
+#ifdef _WIN32
+    return _getpid();
+#else
+    return (long)getpid();
+#endif
+}
+
+static uint64_t fnv1a(const void *data, size_t len, uint64_t hash = 14695981039346656037ULL)
+{
+    const unsigned char *p = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < len; ++i)
+    {
+        hash = (hash ^ p[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+uint64_t imageHash(const cv::Mat &img)
+{
+    int dims[3] = {img.rows, img.cols, img.type()};
+    uint64_t hash = fnv1a(dims, sizeof(dims));
+    size_t rowBytes = img.cols * img.elemSize();
+    for (int r = 0; r < img.rows; ++r)
+    {
+        hash = fnv1a(img.ptr(r), rowBytes, hash);
+    }
+    return hash;
+}
+
+string featureCacheFile(const string &dir, uint64_t imgHash, const string &paramKey)
+{
+    ostringstream name;
+    name << dir;
+    if (!dir.empty() && dir.back() != '/' && dir.back() != '\\')
+    {
+        name << '/';
+    }
+    name << hex << setfill('0') << setw(16) << imgHash << '-' << setw(16) << fnv1a(paramKey.data(), paramKey.size()) << ".feat";
+    return name.str();
+}
+
+bool loadFeatures(const string &filename, uint64_t imgHash, const string &paramKey, DataFrame &frame)
+{
+    shared_ptr<MappedFile> file;
+    try
+    {
+        file = make_shared<MappedFile>(filename);
+    }
+    catch (const runtime_error &)
+    {
+        return false; // not cached yet
+    }
+
+    FeatureFileHeader header;
+    if (file->size() < sizeof(header))
+    {
+        return false;
+    }
+    memcpy(&header, file->data(), sizeof(header));
+    if (memcmp(header.magic, featureFileMagic, sizeof(header.magic)) != 0 || header.version != featureFileVersion ||
+        header.imageHash != imgHash || header.keyLength != paramKey.size() ||
+        file->size() < sizeof(header) + header.keyLength ||
+        memcmp(file->data() + sizeof(header), paramKey.data(), paramKey.size()) != 0)
+    {
+        return false; // other format version or hash collision
+    }
+
+    size_t kptOffset, descOffset;
+    sectionOffsets(header, kptOffset, descOffset);
+    size_t descBytes = (size_t)header.descRows * header.descCols * CV_ELEM_SIZE(header.descType);
+    if (file->size() < descOffset + descBytes)
+    {
+        return false; // truncated
+    }
+
+    releaseCachedFeatures(frame);
+    frame.keypoints.resize(header.numKeypoints);
+    if (header.numKeypoints > 0)
+    {
+        memcpy(frame.keypoints.data(), file->data() + kptOffset, header.numKeypoints * sizeof(cv::KeyPoint));
+    }
+    if (descBytes > 0)
+    {
+        // read-only view into the mapping, nothing is copied
+        frame.descriptors = cv::Mat(header.descRows, header.descCols, header.descType,
+                                    const_cast<unsigned char *>(file->data() + descOffset));
+        frame.featureStorage = file;
+    }
+    else
+    {
+        frame.descriptors.release();
+    }
+    return true;
+}
+
+bool saveFeatures(const string &filename, uint64_t imgHash, const string &paramKey, const DataFrame &frame)
+{
+    FeatureFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, featureFileMagic, sizeof(header.magic));
+    header.version = featureFileVersion;
+    header.imageHash = imgHash;
+    header.keyLength = (uint32_t)paramKey.size();
+    header.numKeypoints = (uint32_t)frame.keypoints.size();
+    header.descRows = frame.descriptors.rows;
+    header.descCols = frame.descriptors.cols;
+    header.descType = frame.descriptors.type();
+
+    size_t kptOffset, descOffset;
+    sectionOffsets(header, kptOffset, descOffset);
+
+    // one temporary file per writer, so concurrent runs and batch workers storing the same frame do not interfere
+    ostringstream tmpName;
+    tmpName << filename << "." << processId() << "-" << hex << hash<thread::id>()(this_thread::get_id()) << ".tmp";
+    string tmpFilename = tmpName.str();
+    {
+        ofstream os(tmpFilename.c_str(), ios::binary | ios::trunc);
+        if (!os)
+        {
+            return false;
+        }
+        const char zeros[sectionAlignment] = {};
+        os.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        os.write(paramKey.data(), paramKey.size());
+        os.write(zeros, kptOffset - sizeof(header) - paramKey.size());
+        os.write(reinterpret_cast<const char *>(frame.keypoints.data()), frame.keypoints.size() * sizeof(cv::KeyPoint));
+        os.write(zeros, descOffset - kptOffset - frame.keypoints.size() * sizeof(cv::KeyPoint));
+        size_t rowBytes = frame.descriptors.cols * frame.descriptors.elemSize();
+        for (int r = 0; r < frame.descriptors.rows; ++r)
+        {
+            os.write(reinterpret_cast<const char *>(frame.descriptors.ptr(r)), rowBytes);
+        }
+        if (!os)
+        {
+            os.close();
+            remove(tmpFilename.c_str());
+            return false;
+        }
+    }
+
+    // rename atomically replaces an existing file on POSIX, readers see either the old or the new file
+    bool bRenamed = rename(tmpFilename.c_str(), filename.c_str()) == 0;
+#ifdef _WIN32
+    if (!bRenamed)
+    {
+        // Windows does not rename onto an existing file, which then briefly disappears
+        remove(filename.c_str());
+        bRenamed = rename(tmpFilename.c_str(), filename.c_str()) == 0;
+    }
+#endif
+    if (!bRenamed)
+    {
+        remove(tmpFilename.c_str());
+    }
+    return bRenamed;
+}
+
+void releaseCachedFeatures(DataFrame &frame)
+{
+    if (frame.featureStorage)
+    {
+        frame.descriptors.release(); // would otherwise be refilled in place, i.e. inside the read-only mapping
+        frame.featureStorage.reset();
+    }
+}
@@ -0,0 +1,33 @@
+#ifndef featureCache_hpp
+#define featureCache_hpp
+
+#include <string>
+#include <cstdint>
+#include <opencv2/core.hpp>
+
+#include "dataStructures.h"
+
+
+// On-disk cache of detected keypoints and their descriptors, one binary file per (image, parameters) pair.
+// A file holds a small header, the parameter key, the keypoints in cv::KeyPoint layout and the descriptor matrix,
+// each section 64 byte aligned, so a memory-mapped file can be used in place.
+
+// 64 bit FNV-1a hash over size, type and pixels of the image
+uint64_t imageHash(const cv::Mat &img);
+
+// Path of the cache file for the given image hash and parameter key inside dir
+std::string featureCacheFile(const std::string &dir, uint64_t imgHash, const std::string &paramKey);
+
+// Memory-map a cache file and hand its features to the frame: keypoints are copied in one block, descriptors are a
+// cv::Mat header into the mapping, which frame.featureStorage keeps alive. Returns false if there is no file or it
+// was written for a different image or different parameters.
+bool loadFeatures(const std::string &filename, uint64_t imgHash, const std::string &paramKey, DataFrame &frame);
+
+// Write the frame's keypoints and descriptors, through a temporary file of this process and thread which is renamed
+// when complete, so concurrent readers never see a partial file. Returns false if the file could not be written.
+bool saveFeatures(const std::string &filename, uint64_t imgHash, const std::string &paramKey, const DataFrame &frame);
+
+// Drop descriptors which point into a cache mapping, so that the frame's slot can be refilled safely
+void releaseCachedFeatures(DataFrame &frame);
+
+#endif /* featureCache_hpp */
@@ -0,0 +1,94 @@
+#include <stdexcept>
+#include <algorithm>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "frameSource.hpp"
+
+using namespace std;
+
+ImageSequenceSource::ImageSequenceSource(function<string(size_t)> filenameOf, size_t maxFrames)
+    : filenameOf(filenameOf), maxFrames(maxFrames), index(0)
+{
+}
+
+bool ImageSequenceSource::read(cv::Mat &img)
+{
+    if (maxFrames > 0 && index >= maxFrames)
+    {
+        return false;
+    }
+
+    string filename = filenameOf(index);
+    imgColor = cv::imread(filename);
+    if (imgColor.empty())
+    {
+        if (maxFrames == 0)
+        {
+            return false; // open-ended sequence, the first missing file ends it
+        }
+        throw runtime_error("could not load image " + filename);
+    }
+    cv::cvtColor(imgColor, img, cv::COLOR_BGR2GRAY);
+    ++index;
+    return true;
+}
+
+VideoCaptureSource::VideoCaptureSource(const string &uri)
+{
+    bool bDevice = !uri.empty() && all_of(uri.begin(), uri.end(), [](char c) { return c >= '0' && c <= '9'; });
+
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && (CV_VERSION_MINOR > 5 || (CV_VERSION_MINOR == 5 && CV_VERSION_REVISION >= 2)))
+    vector<int> params = {cv::CAP_PROP_HW_ACCELERATION, cv::VIDEO_ACCELERATION_ANY};
+    bool bOpened = bDevice ? capture.open(stoi(uri), cv::CAP_ANY, params) : capture.open(uri, cv::CAP_ANY, params);
+#else
+    bool bOpened = bDevice ? capture.open(stoi(uri)) : capture.open(uri);
+#endif
+    if (!bOpened || !capture.isOpened())
+    {
+        throw runtime_error("could not open video source " + uri);
+    }
+    if (bDevice)
+    {
+        capture.set(cv::CAP_PROP_BUFFERSIZE, 1); // not supported by every backend, then simply ignored
+    }
+}
+
+bool VideoCaptureSource::read(cv::Mat &img)
+{
+    if (!capture.read(frame) || frame.empty())
+    {
+        return false;
+    }
+    if (frame.channels() == 1)
+    {
+        frame.copyTo(img);
+    }
+    else
+    {
+        cv::cvtColor(frame, img, cv::COLOR_BGR2GRAY);
+    }
+    return true;
+}
+
+RawGrayscaleSource::RawGrayscaleSource(const string &filename, cv::Size frameSize)
+    : file(filename), frameSize(frameSize), numFrames(0), index(0)
+{
+    if (frameSize.area() <= 0)
+    {
+        throw invalid_argument("raw frame size must not be empty");
+    }
+    numFrames = file.size() / frameSize.area();
+}
+
+bool RawGrayscaleSource::read(cv::Mat &img)
+{
+    if (index >= numFrames)
+    {
+        return false;
+    }
+    const unsigned char *frameData = file.data() + index * frameSize.area();
+    img = cv::Mat(frameSize.height, frameSize.width, CV_8UC1, const_cast<unsigned char *>(frameData));
+    ++index;
+    return true;
+}
@@ -0,0 +1,71 @@
+#ifndef frameSource_hpp
+#define frameSource_hpp
+
+#include <string>
+#include <cstddef>
+#include <functional>
+#include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+
+#include "mappedFile.hpp"
+
+
+// Source of 8bit grayscale camera frames, read one after another until the stream ends
+class FrameSource
+{
+public:
+    virtual ~FrameSource() {}
+
+    // next frame into img, returns false at the end of the stream (img is then left untouched),
+    // throws if a frame which should exist could not be read
+    virtual bool read(cv::Mat &img) = 0;
+};
+
+// Numbered image files, decoded with cv::imread. With maxFrames == 0 the sequence is open-ended and ends
+// at the first missing file, otherwise exactly maxFrames files are expected.
+class ImageSequenceSource : public FrameSource
+{
+public:
+    ImageSequenceSource(std::function<std::string(std::size_t)> filenameOf, std::size_t maxFrames);
+    bool read(cv::Mat &img) override;
+
+private:
+    std::function<std::string(std::size_t)> filenameOf;
+    std::size_t maxFrames;
+    std::size_t index;
+    cv::Mat imgColor; // decoded image, reused between frames
+};
+
+// Video file, stream URL or camera (a uri made of digits only is taken as device index).
+// Hardware decoding is requested where OpenCV supports it (4.5.2+); cameras only buffer a single frame,
+// so a slow consumer always gets a recent frame instead of an ever growing backlog.
+class VideoCaptureSource : public FrameSource
+{
+public:
+    explicit VideoCaptureSource(const std::string &uri);
+    bool read(cv::Mat &img) override;
+
+private:
+    cv::VideoCapture capture;
+    cv::Mat frame; // decoded frame before grayscale conversion, reused between frames
+};
+
+// Headerless dump of 8bit grayscale frames of equal size, back to back in one file. The file is memory-mapped
+// and frames are handed out as cv::Mat headers into the mapping without any copy, so they are read-only and
+// only valid as long as the source exists.
+class RawGrayscaleSource : public FrameSource
+{
+public:
+    RawGrayscaleSource(const std::string &filename, cv::Size frameSize);
+
+    bool read(cv::Mat &img) override;
+    std::size_t frameCount() const { return numFrames; }
+
+private:
+    MappedFile file;
+    cv::Size frameSize;
+    std::size_t numFrames;
+    std::size_t index;
+};
+
+#endif /* frameSource_hpp */
@@ -0,0 +1,180 @@
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+
+#include "gatedMatcher.hpp"
+#include "hammingMatcher.hpp"
+
+using namespace std;
+
+// Uniform grid over keypoint positions, cells hold indices into the keypoint list
+struct KeypointGrid {
+    float cellSize;
+    int cols, rows;
+    vector<vector<int>> cells;
+
+    KeypointGrid(const vector<cv::KeyPoint> &kpts, float cellSize) : cellSize(cellSize), cols(1), rows(1)
+    {
+        float maxX = 0.0f, maxY = 0.0f;
+        for (auto it = kpts.begin(); it != kpts.end(); ++it)
+        {
+            maxX = max(maxX, it->pt.x);
+            maxY = max(maxY, it->pt.y);
+        }
+        cols = (int)(maxX / cellSize) + 1;
+        rows = (int)(maxY / cellSize) + 1;
+        cells.resize(cols * rows);
+        for (int i = 0; i < (int)kpts.size(); ++i)
+        {
+            cells[cellRow(kpts[i].pt.y) * cols + cellCol(kpts[i].pt.x)].push_back(i);
+        }
+    }
+
+    int cellCol(float x) const { return min(cols - 1, max(0, (int)floor(x / cellSize))); }
+    int cellRow(float y) const { return min(rows - 1, max(0, (int)floor(y / cellSize))); }
+};
+
+// Descriptor distance for the norm fixed at compile time, so the pair loop below carries no norm branch
+template <int NormType>
+static float descriptorDistance(const cv::Mat &descSource, int i, const cv::Mat &descRef, int j, float bound);
+
+template <>
+float descriptorDistance<cv::NORM_HAMMING>(const cv::Mat &descSource, int i, const cv::Mat &descRef, int j, float bound)
+{
+    int ibound = bound >= (float)numeric_limits<int>::max() ? numeric_limits<int>::max() : (int)ceil(bound);
+    return (float)hammingDistance(descSource.ptr<uchar>(i), descRef.ptr<uchar>(j), descSource.cols, ibound);
+}
+
+template <>
+float descriptorDistance<cv::NORM_L2>(const cv::Mat &descSource, int i, const cv::Mat &descRef, int j, float)
+{
+    const float *a = descSource.ptr<float>(i), *b = descRef.ptr<float>(j);
+    float sum = 0.0f;
+    for (int k = 0; k < descSource.cols; ++k)
+    {
+        float d = a[k] - b[k];
+        sum += d * d;
+    }
+    return sqrt(sum);
+}
+
+// One instantiation per norm and selector, both are resolved once per call in matchDescriptorsGated
+template <int NormType, bool bRatioTest>
+static void matchGated(const vector<cv::KeyPoint> &kPtsSource, const vector<cv::KeyPoint> &kPtsRef,
+                       const cv::Mat &descSource, const cv::Mat &descRef, vector<cv::DMatch> &matches,
+                       float radius, cv::Point2f offset, float ratio)
+{
+    KeypointGrid grid(kPtsRef, max(1.0f, radius));
+    float radiusSq = radius * radius;
+    matches.reserve(matches.size() + kPtsSource.size());
+
+    for (int i = 0; i < (int)kPtsSource.size(); ++i)
+    {
+        cv::Point2f p = kPtsSource[i].pt + offset;
+        int bestIdx = -1;
+        float bestDist = numeric_limits<float>::max(), secondDist = numeric_limits<float>::max();
+
+        for (int cy = grid.cellRow(p.y - radius); cy <= grid.cellRow(p.y + radius); ++cy)
+        {
+            for (int cx = grid.cellCol(p.x - radius); cx <= grid.cellCol(p.x + radius); ++cx)
+            {
+                const vector<int> &cell = grid.cells[cy * grid.cols + cx];
+                for (auto it = cell.begin(); it != cell.end(); ++it)
+                {
+                    cv::Point2f d = kPtsRef[*it].pt - p;
+                    if (d.x * d.x + d.y * d.y > radiusSq)
+                    {
+                        continue;
+                    }
+                    float dist = descriptorDistance<NormType>(descSource, i, descRef, *it, bRatioTest ? secondDist : bestDist);
+                    if (dist < bestDist)
+                    {
+                        secondDist = bestDist;
+                        bestDist = dist;
+                        bestIdx = *it;
+                    }
+                    else if (dist < secondDist)
+                    {
+                        secondDist = dist;
+                    }
+                }
+            }
+        }
+
+        if (bestIdx < 0)
+        {
+            continue; // nothing inside the gate
+        }
+        if (!bRatioTest)
+        {
+            matches.push_back(cv::DMatch(i, bestIdx, bestDist));
+        }
+        else if (secondDist < numeric_limits<float>::max() && bestDist < ratio * secondDist)
+        {
+            matches.push_back(cv::DMatch(i, bestIdx, bestDist));
+        }
+    }
+}
+
+void matchDescriptorsGated(const vector<cv::KeyPoint> &kPtsSource, const vector<cv::KeyPoint> &kPtsRef,
+                           const cv::Mat &descSource, const cv::Mat &descRef, vector<cv::DMatch> &matches,
+                           int normType, const string &selectorType, float radius, cv::Point2f offset, float ratio)
+{
+    if (descSource.rows != (int)kPtsSource.size() || descRef.rows != (int)kPtsRef.size() || descSource.cols != descRef.cols)
+    {
+        throw invalid_argument("gated matching needs one descriptor row per keypoint");
+    }
+    int expectedDepth = normType == cv::NORM_HAMMING ? CV_8U : CV_32F;
+    if ((!descSource.empty() && descSource.depth() != expectedDepth) || (!descRef.empty() && descRef.depth() != expectedDepth))
+    {
+        throw invalid_argument("descriptor type does not fit the norm of the gated matcher");
+    }
+    if (kPtsRef.empty())
+    {
+        return;
+    }
+
+    bool bRatioTest = selectorType.compare("SEL_KNN") == 0;
+    if (normType == cv::NORM_HAMMING)
+    {
+        if (bRatioTest)
+        {
+            matchGated<cv::NORM_HAMMING, true>(kPtsSource, kPtsRef, descSource, descRef, matches, radius, offset, ratio);
+        }
+        else
+        {
+            matchGated<cv::NORM_HAMMING, false>(kPtsSource, kPtsRef, descSource, descRef, matches, radius, offset, ratio);
+        }
+    }
+    else if (bRatioTest)
+    {
+        matchGated<cv::NORM_L2, true>(kPtsSource, kPtsRef, descSource, descRef, matches, radius, offset, ratio);
+    }
+    else
+    {
+        matchGated<cv::NORM_L2, false>(kPtsSource, kPtsRef, descSource, descRef, matches, radius, offset, ratio);
+    }
+}
+
+cv::Point2f medianDisplacement(const vector<cv::KeyPoint> &kPtsSource, const vector<cv::KeyPoint> &kPtsRef,
+                               const vector<cv::DMatch> &matches)
+{
+    if (matches.empty())
+    {
+        return cv::Point2f(0.0f, 0.0f);
+    }
+
+    vector<float> dx, dy;
+    dx.reserve(matches.size());
+    dy.reserve(matches.size());
+    for (auto it = matches.begin(); it != matches.end(); ++it)
+    {
+        cv::Point2f d = kPtsRef[it->trainIdx].pt - kPtsSource[it->queryIdx].pt;
+        dx.push_back(d.x);
+        dy.push_back(d.y);
+    }
+    nth_element(dx.begin(), dx.begin() + dx.size() / 2, dx.end());
+    nth_element(dy.begin(), dy.begin() + dy.size() / 2, dy.end());
+    return cv::Point2f(dx[dx.size() / 2], dy[dy.size() / 2]);
+}
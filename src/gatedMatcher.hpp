@@ -0,0 +1,21 @@
+#ifndef gatedMatcher_hpp
+#define gatedMatcher_hpp
+
+#include <vector>
+#include <string>
+#include <opencv2/core.hpp>
+
+
+// Spatially gated matching: reference keypoints are bucketed into a grid and every source keypoint is only
+// compared against references within `radius` pixels of its position shifted by the predicted motion `offset`.
+// normType is cv::NORM_HAMMING for CV_8U descriptors or cv::NORM_L2 for CV_32F descriptors,
+// selectorType is SEL_NN or SEL_KNN (2-NN with ratio test inside the gate).
+void matchDescriptorsGated(const std::vector<cv::KeyPoint> &kPtsSource, const std::vector<cv::KeyPoint> &kPtsRef,
+                           const cv::Mat &descSource, const cv::Mat &descRef, std::vector<cv::DMatch> &matches,
+                           int normType, const std::string &selectorType, float radius, cv::Point2f offset, float ratio);
+
+// Median displacement from source to reference keypoints over all matches, (0,0) if there are none
+cv::Point2f medianDisplacement(const std::vector<cv::KeyPoint> &kPtsSource, const std::vector<cv::KeyPoint> &kPtsRef,
+                               const std::vector<cv::DMatch> &matches);
+
+#endif /* gatedMatcher_hpp */
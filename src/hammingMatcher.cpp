@@ -0,0 +1,187 @@
+#include <cstring>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+
+#if defined(__AVX2__) || defined(__AVX512VPOPCNTDQ__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include "hammingMatcher.hpp"
+
+using namespace std;
+
+static inline int popcount64(uint64_t x)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcountll(x);
+#else
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    return (int)((x * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+// popcount of a XOR b over one SIMD block, BLOCK_BYTES bytes of input
+#if defined(__AVX512VPOPCNTDQ__)
+static const int BLOCK_BYTES = 64;
+static inline int blockDistance(const uchar *a, const uchar *b)
+{
+    __m512i x = _mm512_xor_si512(_mm512_loadu_si512((const void *)a), _mm512_loadu_si512((const void *)b));
+    return (int)_mm512_reduce_add_epi64(_mm512_popcnt_epi64(x));
+}
+#elif defined(__AVX2__)
+static const int BLOCK_BYTES = 32;
+static inline int blockDistance(const uchar *a, const uchar *b)
+{
+    // nibble lookup popcount, summed per 64-bit lane with SAD
+    const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                         0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i lowMask = _mm256_set1_epi8(0x0f);
+    __m256i x = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)a), _mm256_loadu_si256((const __m256i *)b));
+    __m256i lo = _mm256_and_si256(x, lowMask);
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi16(x, 4), lowMask);
+    __m256i cnt = _mm256_add_epi8(_mm256_shuffle_epi8(lut, lo), _mm256_shuffle_epi8(lut, hi));
+    __m256i sum = _mm256_sad_epu8(cnt, _mm256_setzero_si256());
+    return (int)(_mm256_extract_epi64(sum, 0) + _mm256_extract_epi64(sum, 1) +
+                 _mm256_extract_epi64(sum, 2) + _mm256_extract_epi64(sum, 3));
+}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+static const int BLOCK_BYTES = 16;
+static inline int blockDistance(const uchar *a, const uchar *b)
+{
+    uint8x16_t cnt = vcntq_u8(veorq_u8(vld1q_u8(a), vld1q_u8(b)));
+    return (int)vaddlvq_u8(cnt);
+}
+#else
+static const int BLOCK_BYTES = 8;
+static inline int blockDistance(const uchar *a, const uchar *b)
+{
+    uint64_t x, y;
+    memcpy(&x, a, 8);
+    memcpy(&y, b, 8);
+    return popcount64(x ^ y);
+}
+#endif
+
+const char *hammingKernelName()
+{
+#if defined(__AVX512VPOPCNTDQ__)
+    return "avx512-vpopcntdq";
+#elif defined(__AVX2__)
+    return "avx2";
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    return "neon";
+#else
+    return "scalar";
+#endif
+}
+
+int hammingDistance(const uchar *a, const uchar *b, int len, int bound)
+{
+    int dist = 0;
+    int i = 0;
+    for (; i + BLOCK_BYTES <= len; i += BLOCK_BYTES)
+    {
+        dist += blockDistance(a + i, b + i);
+        if (dist >= bound)
+        {
+            return dist; // early exit, this candidate cannot be among the two best anymore
+        }
+    }
+    for (; i + 8 <= len; i += 8)
+    {
+        uint64_t x, y;
+        memcpy(&x, a + i, 8);
+        memcpy(&y, b + i, 8);
+        dist += popcount64(x ^ y);
+    }
+    for (; i < len; ++i)
+    {
+        dist += popcount64((uint64_t)(a[i] ^ b[i]));
+    }
+    return dist;
+}
+
+// false if one side has no descriptors (a frame without keypoints), which like cv::BFMatcher gives no matches
+static bool checkDescriptors(const cv::Mat &descSource, const cv::Mat &descRef)
+{
+    if (descSource.empty() || descRef.empty())
+    {
+        return false;
+    }
+    if (descSource.depth() != CV_8U || descRef.depth() != CV_8U || descSource.cols != descRef.cols)
+    {
+        throw invalid_argument("Hamming matcher needs CV_8U descriptors of equal length");
+    }
+    return true;
+}
+
+// best and second-best reference for one query row
+static void searchTwoBest(const uchar *query, const cv::Mat &descRef, int &bestIdx, int &bestDist, int &secondDist)
+{
+    bestIdx = -1;
+    bestDist = numeric_limits<int>::max();
+    secondDist = numeric_limits<int>::max();
+    for (int r = 0; r < descRef.rows; ++r)
+    {
+        int dist = hammingDistance(query, descRef.ptr<uchar>(r), descRef.cols, secondDist);
+        if (dist < bestDist)
+        {
+            secondDist = bestDist;
+            bestDist = dist;
+            bestIdx = r;
+        }
+        else if (dist < secondDist)
+        {
+            secondDist = dist;
+        }
+    }
+}
+
+void matchHammingNN(const cv::Mat &descSource, const cv::Mat &descRef, vector<cv::DMatch> &matches)
+{
+    if (!checkDescriptors(descSource, descRef))
+    {
+        return;
+    }
+
+    matches.reserve(matches.size() + descSource.rows);
+    for (int q = 0; q < descSource.rows; ++q)
+    {
+        const uchar *query = descSource.ptr<uchar>(q);
+        int bestIdx = -1, bestDist = numeric_limits<int>::max();
+        for (int r = 0; r < descRef.rows; ++r)
+        {
+            int dist = hammingDistance(query, descRef.ptr<uchar>(r), descRef.cols, bestDist);
+            if (dist < bestDist)
+            {
+                bestDist = dist;
+                bestIdx = r;
+            }
+        }
+        matches.push_back(cv::DMatch(q, bestIdx, (float)bestDist));
+    }
+}
+
+void matchHammingKnnRatio(const cv::Mat &descSource, const cv::Mat &descRef, vector<cv::DMatch> &matches, float ratio)
+{
+    if (!checkDescriptors(descSource, descRef) || descRef.rows < 2)
+    {
+        return; // ratio test needs a second neighbour
+    }
+
+    matches.reserve(matches.size() + descSource.rows);
+    for (int q = 0; q < descSource.rows; ++q)
+    {
+        int bestIdx, bestDist, secondDist;
+        searchTwoBest(descSource.ptr<uchar>(q), descRef, bestIdx, bestDist, secondDist);
+        if (bestDist < ratio * secondDist)
+        {
+            matches.push_back(cv::DMatch(q, bestIdx, (float)bestDist));
+        }
+    }
+}
@@ -0,0 +1,24 @@
+#ifndef hammingMatcher_hpp
+#define hammingMatcher_hpp
+
+#include <vector>
+#include <opencv2/core.hpp>
+
+
+// Brute-force matcher for binary (CV_8U) descriptors using hardware popcount
+// (AVX-512 VPOPCNTDQ, AVX2 or NEON when compiled for it, scalar popcount otherwise).
+// Each query keeps a running best / second-best reference, so the ratio test needs no k-NN result lists.
+
+// name of the SIMD kernel selected at compile time, e.g. "avx2"
+const char *hammingKernelName();
+
+// Hamming distance between two descriptors of len bytes, stops early once the distance reaches bound
+int hammingDistance(const uchar *a, const uchar *b, int len, int bound);
+
+// nearest neighbour in descRef for every row of descSource
+void matchHammingNN(const cv::Mat &descSource, const cv::Mat &descRef, std::vector<cv::DMatch> &matches);
+
+// 2-NN with the descriptor distance ratio test applied inline, keeps matches with best < ratio * secondBest
+void matchHammingKnnRatio(const cv::Mat &descSource, const cv::Mat &descRef, std::vector<cv::DMatch> &matches, float ratio);
+
+#endif /* hammingMatcher_hpp */
@@ -0,0 +1,100 @@
+#include <stdexcept>
+#include <opencv2/highgui/highgui.hpp>
+
+#include "imagePrefetcher.hpp"
+
+using namespace std;
+
+ImagePrefetcher::ImagePrefetcher(const vector<string> &filenames, size_t capacity, int numThreads)
+    : filenames(filenames), capacity(capacity > 0 ? capacity : 1), nextToDecode(0), consumed(0), stopping(false)
+{
+    for (int i = 0; i < max(1, numThreads); ++i)
+    {
+        workers.push_back(thread(&ImagePrefetcher::decodeLoop, this));
+    }
+}
+
+ImagePrefetcher::~ImagePrefetcher()
+{
+    {
+        lock_guard<mutex> lock(mtx);
+        stopping = true;
+    }
+    workAvailable.notify_all();
+    for (auto it = workers.begin(); it != workers.end(); ++it)
+    {
+        it->join();
+    }
+}
+
+void ImagePrefetcher::decodeLoop()
+{
+    unique_lock<mutex> lock(mtx);
+    while (true)
+    {
+        // only decode up to `capacity` frames ahead of the consumer
+        workAvailable.wait(lock, [this]() {
+            return stopping || (nextToDecode < filenames.size() && nextToDecode < consumed + capacity);
+        });
+        if (stopping)
+        {
+            return;
+        }
+        size_t imgIndex = nextToDecode++;
+
+        lock.unlock();
+        cv::Mat img;
+        try
+        {
+            img = cv::imread(filenames[imgIndex], cv::IMREAD_GRAYSCALE);
+        }
+        catch (const cv::Exception &)
+        {
+            // an empty image is reported to the consumer in read()
+        }
+        lock.lock();
+
+        cache[imgIndex] = img;
+        frameReady.notify_all();
+    }
+}
+
+bool ImagePrefetcher::read(cv::Mat &img)
+{
+    unique_lock<mutex> lock(mtx);
+    if (consumed >= filenames.size())
+    {
+        return false;
+    }
+
+    auto it = cache.find(consumed);
+    if (it != cache.end())
+    {
+        ++counters.hits;
+    }
+    else
+    {
+        ++counters.stalls;
+        double t = (double)cv::getTickCount();
+        frameReady.wait(lock, [this, &it]() { return (it = cache.find(consumed)) != cache.end(); });
+        counters.stallSeconds += ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+    }
+
+    img = it->second;
+    cache.erase(it);
+    size_t imgIndex = consumed++;
+    lock.unlock();
+    workAvailable.notify_all();
+
+    if (img.empty())
+    {
+        throw runtime_error("could not load image " + filenames[imgIndex]);
+    }
+    return true;
+}
+
+PrefetchStats ImagePrefetcher::stats() const
+{
+    lock_guard<mutex> lock(mtx);
+    return counters;
+}
@@ -0,0 +1,53 @@
+#ifndef imagePrefetcher_hpp
+#define imagePrefetcher_hpp
+
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <opencv2/core.hpp>
+
+#include "frameSource.hpp"
+
+
+struct PrefetchStats { // tells how well the prefetch capacity fits the consumer
+    std::size_t hits = 0;     // frames which were already decoded when requested
+    std::size_t stalls = 0;   // frames the consumer had to wait for
+    double stallSeconds = 0.0; // total time spent waiting
+};
+
+// Decodes the next frames of an image list on background threads, straight to grayscale.
+// At most `capacity` frames ahead of the consumer are decoded and cached, frames are handed out in list order.
+class ImagePrefetcher : public FrameSource
+{
+public:
+    ImagePrefetcher(const std::vector<std::string> &filenames, std::size_t capacity, int numThreads);
+    ~ImagePrefetcher();
+
+    ImagePrefetcher(const ImagePrefetcher &) = delete;
+    ImagePrefetcher &operator=(const ImagePrefetcher &) = delete;
+
+    // hands out the next decoded frame, returns false at the end of the list, throws if the image could not be loaded
+    bool read(cv::Mat &img) override;
+
+    PrefetchStats stats() const;
+
+private:
+    void decodeLoop();
+
+    std::vector<std::string> filenames;
+    std::size_t capacity;
+    std::map<std::size_t, cv::Mat> cache; // decoded frames not yet handed out, keyed by list index
+    std::size_t nextToDecode; // next list index a worker will pick up
+    std::size_t consumed;     // no. of frames handed out so far
+    bool stopping;
+    PrefetchStats counters;
+
+    mutable std::mutex mtx;
+    std::condition_variable workAvailable, frameReady;
+    std::vector<std::thread> workers;
+};
+
+#endif /* imagePrefetcher_hpp */
@@ -0,0 +1,332 @@
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <map>
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+
+#include "instrumentation.hpp"
+
+using namespace std;
+
+struct TraceEvent {
+    const char *name;
+    int64_t startNs; // since the instrumentation epoch
+    int64_t durationNs;
+    double value;
+    bool bCounter;
+};
+
+// Running summary of one timer or counter. Percentiles come from a log-linear histogram: every power of two is split
+// into subBuckets buckets, so p50 / p99 are within about 5% of the exact value, with constant memory per name.
+static const int subBuckets = 8;
+static const int maxExponent = 48;
+static const int numBuckets = 1 + maxExponent * subBuckets; // bucket 0 holds everything below 1 (us or counter unit)
+
+struct StageAccumulator {
+    const char *name = nullptr;
+    bool bCounter = false;
+    size_t count = 0;
+    double total = 0.0, min = 0.0, max = 0.0; // timers in ms
+    size_t buckets[numBuckets];                // timers over microseconds, counters over their values
+
+    StageAccumulator() { fill(buckets, buckets + numBuckets, (size_t)0); }
+};
+
+static const size_t traceCapacity = 1 << 15; // trace events kept per thread, older ones are overwritten
+
+struct ThreadBuffer { // only ever written to by its owning thread
+    int threadId;
+    vector<StageAccumulator> stages; // one per timer or counter name, found by pointer
+    vector<TraceEvent> events;       // ring of the last traceCapacity events
+    size_t nextEvent = 0;
+    bool bWrapped = false;
+};
+
+static atomic<bool> bRecording(false);
+static atomic<bool> bLogging(false);
+static thread_local bool bCountersMuted = false;
+static const chrono::steady_clock::time_point epoch = chrono::steady_clock::now();
+
+// all buffers ever handed out, they outlive their threads so late dumps still see every event
+static mutex registryMutex;
+static vector<shared_ptr<ThreadBuffer>> registry;
+
+static ThreadBuffer &threadBuffer()
+{
+    thread_local shared_ptr<ThreadBuffer> buffer;
+    if (!buffer)
+    {
+        buffer = make_shared<ThreadBuffer>();
+        buffer->stages.reserve(64);
+        buffer->events.resize(traceCapacity);
+        lock_guard<mutex> lock(registryMutex);
+        buffer->threadId = (int)registry.size();
+        registry.push_back(buffer);
+    }
+    return *buffer;
+}
+
+static int64_t toNs(chrono::steady_clock::time_point t)
+{
+    return chrono::duration_cast<chrono::nanoseconds>(t - epoch).count();
+}
+
+static int bucketOf(double v)
+{
+    if (!(v >= 1.0))
+    {
+        return 0;
+    }
+    int e;
+    double m = frexp(v, &e); // v = m * 2^e with m in [0.5, 1)
+    int idx = 1 + (e - 1) * subBuckets + (int)((2.0 * m - 1.0) * subBuckets);
+    return min(idx, numBuckets - 1);
+}
+
+// value range [lo, hi) of a bucket
+static void bucketRange(int idx, double &lo, double &hi)
+{
+    if (idx == 0)
+    {
+        lo = 0.0;
+        hi = 1.0;
+        return;
+    }
+    int e = (idx - 1) / subBuckets, sub = (idx - 1) % subBuckets;
+    lo = ldexp(1.0 + (double)sub / subBuckets, e);
+    hi = ldexp(1.0 + (double)(sub + 1) / subBuckets, e);
+}
+
+static void recordSample(const char *name, bool bCounter, double value, const TraceEvent &ev)
+{
+    ThreadBuffer &buf = threadBuffer();
+
+    StageAccumulator *acc = nullptr;
+    for (auto it = buf.stages.begin(); it != buf.stages.end() && !acc; ++it)
+    {
+        if (it->name == name && it->bCounter == bCounter)
+        {
+            acc = &*it;
+        }
+    }
+    if (!acc)
+    { // first sample of this name on this thread, the only time recording allocates
+        buf.stages.emplace_back();
+        acc = &buf.stages.back();
+        acc->name = name;
+        acc->bCounter = bCounter;
+    }
+    acc->min = acc->count == 0 ? value : min(acc->min, value);
+    acc->max = acc->count == 0 ? value : max(acc->max, value);
+    ++acc->count;
+    acc->total += value;
+    ++acc->buckets[bucketOf(bCounter ? value : value * 1000.0)];
+
+    buf.events[buf.nextEvent] = ev;
+    if (++buf.nextEvent == buf.events.size())
+    {
+        buf.nextEvent = 0;
+        buf.bWrapped = true;
+    }
+}
+
+void setInstrumentationEnabled(bool bEnabled) { bRecording = bEnabled; }
+bool instrumentationEnabled() { return bRecording; }
+void setStageLogging(bool bEnabled) { bLogging = bEnabled; }
+bool stageLoggingEnabled() { return bLogging; }
+
+void addCounter(const char *name, double value)
+{
+    if (!bRecording || bCountersMuted)
+    {
+        return;
+    }
+    TraceEvent ev = {name, toNs(chrono::steady_clock::now()), 0, value, true};
+    recordSample(name, true, value, ev);
+}
+
+void resetInstrumentation()
+{
+    lock_guard<mutex> lock(registryMutex);
+    for (auto it = registry.begin(); it != registry.end(); ++it)
+    {
+        (*it)->stages.clear();
+        (*it)->nextEvent = 0;
+        (*it)->bWrapped = false;
+    }
+}
+
+ScopedCounterMute::ScopedCounterMute() : bWasMuted(bCountersMuted)
+{
+    bCountersMuted = true;
+}
+
+ScopedCounterMute::~ScopedCounterMute()
+{
+    bCountersMuted = bWasMuted;
+}
+
+ScopedTimer::ScopedTimer(const char *name) : name(name), start(chrono::steady_clock::now()) {}
+
+ScopedTimer::~ScopedTimer()
+{
+    if (!bRecording)
+    {
+        return;
+    }
+    chrono::steady_clock::time_point end = chrono::steady_clock::now();
+    int64_t durationNs = chrono::duration_cast<chrono::nanoseconds>(end - start).count();
+    TraceEvent ev = {name, toNs(start), durationNs, 0.0, false};
+    recordSample(name, false, durationNs * 1e-6, ev);
+}
+
+double ScopedTimer::elapsedMs() const
+{
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+// the accumulators of all threads merged by name, timers first
+static vector<StageAccumulator> mergeStages()
+{
+    map<pair<bool, string>, StageAccumulator> merged;
+    lock_guard<mutex> lock(registryMutex);
+    for (auto buf = registry.begin(); buf != registry.end(); ++buf)
+    {
+        for (auto it = (*buf)->stages.begin(); it != (*buf)->stages.end(); ++it)
+        {
+            StageAccumulator &acc = merged[make_pair(it->bCounter, string(it->name))];
+            acc.min = acc.count == 0 ? it->min : min(acc.min, it->min);
+            acc.max = acc.count == 0 ? it->max : max(acc.max, it->max);
+            acc.name = it->name;
+            acc.bCounter = it->bCounter;
+            acc.count += it->count;
+            acc.total += it->total;
+            for (int b = 0; b < numBuckets; ++b)
+            {
+                acc.buckets[b] += it->buckets[b];
+            }
+        }
+    }
+    vector<StageAccumulator> stages;
+    for (auto it = merged.begin(); it != merged.end(); ++it)
+    {
+        stages.push_back(it->second);
+    }
+    return stages;
+}
+
+// nearest-rank percentile, the centre of its bucket within the observed range
+static double percentile(const StageAccumulator &acc, double q)
+{
+    size_t rank = max((size_t)1, (size_t)ceil(q * acc.count)), seen = 0;
+    for (int b = 0; b < numBuckets; ++b)
+    {
+        seen += acc.buckets[b];
+        if (seen >= rank)
+        {
+            double lo, hi;
+            bucketRange(b, lo, hi);
+            double v = 0.5 * (lo + hi) / (acc.bCounter ? 1.0 : 1000.0);
+            return min(max(v, acc.min), acc.max);
+        }
+    }
+    return acc.max;
+}
+
+static StageStats summarize(const StageAccumulator &acc)
+{
+    StageStats s;
+    s.name = acc.name;
+    s.bCounter = acc.bCounter;
+    s.count = acc.count;
+    if (acc.count == 0)
+    {
+        return s;
+    }
+    s.total = acc.total;
+    s.mean = acc.total / acc.count;
+    s.p50 = percentile(acc, 0.50);
+    s.p99 = percentile(acc, 0.99);
+    s.max = acc.max;
+    return s;
+}
+
+vector<StageStats> collectStageStats()
+{
+    vector<StageAccumulator> stages = mergeStages();
+    vector<StageStats> stats;
+    for (auto it = stages.begin(); it != stages.end(); ++it)
+    {
+        stats.push_back(summarize(*it));
+    }
+    return stats;
+}
+
+void writeChromeTrace(ostream &os)
+{
+    lock_guard<mutex> lock(registryMutex);
+    os << "{\"traceEvents\": [" << '\n';
+    bool bFirst = true;
+    for (auto buf = registry.begin(); buf != registry.end(); ++buf)
+    {
+        // oldest first: once the ring has wrapped, the events from nextEvent on are older than those before it
+        const vector<TraceEvent> &events = (*buf)->events;
+        size_t n = (*buf)->bWrapped ? events.size() : (*buf)->nextEvent;
+        size_t first = (*buf)->bWrapped ? (*buf)->nextEvent : 0;
+        for (size_t i = 0; i < n; ++i)
+        {
+            const TraceEvent *ev = &events[(first + i) % events.size()];
+            os << (bFirst ? "" : ",\n") << fixed << setprecision(3);
+            bFirst = false;
+            if (ev->bCounter)
+            {
+                os << "{\"name\": \"" << ev->name << "\", \"ph\": \"C\", \"pid\": 0, \"tid\": " << (*buf)->threadId
+                   << ", \"ts\": " << ev->startNs * 1e-3 << ", \"args\": {\"value\": " << ev->value << "}}";
+            }
+            else
+            {
+                os << "{\"name\": \"" << ev->name << "\", \"ph\": \"X\", \"pid\": 0, \"tid\": " << (*buf)->threadId
+                   << ", \"ts\": " << ev->startNs * 1e-3 << ", \"dur\": " << ev->durationNs * 1e-3 << "}";
+            }
+        }
+    }
+    os << '\n' << "]}" << '\n';
+}
+
+void writeStageHistograms(ostream &os)
+{
+    vector<StageAccumulator> stages = mergeStages();
+
+    os << fixed << setprecision(3);
+    for (auto it = stages.begin(); it != stages.end(); ++it)
+    {
+        StageStats s = summarize(*it);
+        if (it->bCounter)
+        {
+            os << s.name << ": n=" << s.count << " mean=" << s.mean << " p50=" << s.p50 << " p99=" << s.p99
+               << " max=" << s.max << '\n';
+            continue;
+        }
+        os << s.name << ": n=" << s.count << " mean=" << s.mean << " ms p50=" << s.p50 << " ms p99=" << s.p99
+           << " ms max=" << s.max << " ms" << '\n';
+
+        // log2 buckets over microseconds: [0,1), [1,2), [2,4), ... (the sub-buckets of each power of two summed up)
+        for (int b = 0; b < numBuckets; )
+        {
+            int octave = b == 0 ? 0 : (b - 1) / subBuckets + 1;
+            int end = b == 0 ? 1 : b + subBuckets;
+            size_t n = 0;
+            for (; b < end; ++b)
+            {
+                n += it->buckets[b];
+            }
+            if (n > 0)
+            {
+                double lo = octave == 0 ? 0.0 : pow(2.0, octave - 1), hi = pow(2.0, octave);
+                os << "    [" << setw(10) << lo << ", " << setw(10) << hi << ") us : " << n << '\n';
+            }
+        }
+    }
+}
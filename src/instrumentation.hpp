@@ -0,0 +1,68 @@
+#ifndef instrumentation_hpp
+#define instrumentation_hpp
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <chrono>
+#include <cstdint>
+
+
+// Lightweight per-stage instrumentation. Every thread records into its own buffer without locking,
+// the buffers are read by the dump/aggregate functions below which must only be called while no stage is running.
+// Event names are stored by pointer and therefore have to be string literals.
+// Memory stays bounded however long recording is on: the statistics are accumulated in place per name (percentiles
+// from a histogram, within about 5%), and the trace keeps only the most recent events of every thread.
+
+struct StageStats { // aggregated measurements of one timer or counter
+    std::string name;
+    bool bCounter = false; // false -> durations in ms, true -> counter values
+    std::size_t count = 0;
+    double total = 0.0, mean = 0.0, p50 = 0.0, p99 = 0.0, max = 0.0;
+};
+
+void setInstrumentationEnabled(bool bEnabled); // recording is off by default
+bool instrumentationEnabled();
+void setStageLogging(bool bEnabled); // print per-stage messages to stdout, off by default
+bool stageLoggingEnabled();
+
+void addCounter(const char *name, double value); // record one sample of a per-stage counter
+void resetInstrumentation();                      // drop everything recorded so far
+
+// While one exists, the counters of the calling thread are dropped (timers are still recorded), for callers which
+// run a counting function piece by piece, e.g. per tile, and record the total themselves
+class ScopedCounterMute
+{
+public:
+    ScopedCounterMute();
+    ~ScopedCounterMute();
+
+    ScopedCounterMute(const ScopedCounterMute &) = delete;
+    ScopedCounterMute &operator=(const ScopedCounterMute &) = delete;
+
+private:
+    bool bWasMuted;
+};
+
+std::vector<StageStats> collectStageStats();
+void writeChromeTrace(std::ostream &os);   // trace event JSON of the recent events, load with chrome://tracing or Perfetto
+void writeStageHistograms(std::ostream &os); // text summary with a log2 histogram per timer
+
+// Records the time between construction and destruction as one trace event
+class ScopedTimer
+{
+public:
+    explicit ScopedTimer(const char *name);
+    ~ScopedTimer();
+
+    ScopedTimer(const ScopedTimer &) = delete;
+    ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+    double elapsedMs() const; // time since construction
+
+private:
+    const char *name;
+    std::chrono::steady_clock::time_point start;
+};
+
+#endif /* instrumentation_hpp */
@@ -0,0 +1,91 @@
+#include <cmath>
+#include <algorithm>
+
+#include "keypointBudget.hpp"
+#include "matching2D.hpp"
+#include "instrumentation.hpp"
+
+using namespace std;
+
+static const double smoothingUp = 0.7;   // weight of the newest frame in the moving average if it was slower ...
+static const double smoothingDown = 0.2; // ... or faster, so the controller reacts to overruns right away
+static const double headroom = 0.9;      // aim below the deadline, so frame-to-frame jitter does not cross it
+
+// One step towards fewer (direction > 0) or more (direction < 0) detected keypoints, false at the parameter's bound.
+// Detectors without an adjustable threshold are only steered through the keypoint limit.
+static bool adjustDetectorThreshold(PipelineContext &ctx, int direction)
+{
+    switch (ctx.detectorKind)
+    {
+    case DetectorKind::FAST:
+    {
+        int t = ctx.thresholdFAST;
+        int next = direction > 0 ? max(t + 1, (int)lround(t * 1.15)) : min(t - 1, (int)lround(t / 1.15));
+        next = min(max(next, 5), 150);
+        cv::FastFeatureDetector *fast = dynamic_cast<cv::FastFeatureDetector *>(ctx.detector.get());
+        if (next == t || !fast)
+        {
+            return false;
+        }
+        ctx.thresholdFAST = next;
+        fast->setThreshold(next);
+        return true;
+    }
+    case DetectorKind::HARRIS:
+    {
+        int next = min(max(ctx.minResponseHarris + 10 * direction, 30), 240);
+        bool bChanged = next != ctx.minResponseHarris;
+        ctx.minResponseHarris = next;
+        return bChanged;
+    }
+    case DetectorKind::SHITOMASI:
+    {
+        double next = min(max(ctx.qualityLevelShiTomasi * (direction > 0 ? 1.25 : 0.8), 0.001), 0.3);
+        bool bChanged = next != ctx.qualityLevelShiTomasi;
+        ctx.qualityLevelShiTomasi = next;
+        return bChanged;
+    }
+    default:
+        return false;
+    }
+}
+
+void updateKeypointBudget(PipelineContext &ctx, double frameMs, size_t keptKeypoints)
+{
+    KeypointBudget &budget = ctx.budget;
+    double smoothing = frameMs > budget.smoothedMs ? smoothingUp : smoothingDown;
+    budget.smoothedMs = budget.frames == 0 ? frameMs : budget.smoothedMs + smoothing * (frameMs - budget.smoothedMs);
+    ++budget.frames;
+    double target = headroom * budget.deadlineMs;
+
+    // the frame time grows between linearly (description) and quadratically (brute-force matching) with the
+    // no. of keypoints, scaling the limit by the square root of the time ratio does not overshoot in either case.
+    // Back off fast, grow slowly, and only grow a limit which actually cut keypoints off.
+    double scale = sqrt(target / max(budget.smoothedMs, 1e-3));
+    scale = min(max(scale, 0.5), 1.1);
+    bool bLimiting = (int)keptKeypoints >= ctx.maxKeypoints;
+    if (scale < 1.0 || bLimiting)
+    {
+        int limit = (int)lround(ctx.maxKeypoints * scale);
+        ctx.maxKeypoints = min(max(limit, budget.minKeypoints), budget.maxKeypoints);
+    }
+
+    // keep 1.5 - 4x the limit as candidates: fewer and the limit has nothing to choose from, more and detection,
+    // ROI filtering and sorting work on keypoints which are thrown away. At the lowest limit, a frame which is
+    // still too slow leaves the threshold as the only control.
+    if (budget.candidates > 0)
+    {
+        bool bTooSlow = budget.smoothedMs > target && ctx.maxKeypoints == budget.minKeypoints;
+        if (budget.candidates > 4 * (size_t)ctx.maxKeypoints || bTooSlow)
+        {
+            adjustDetectorThreshold(ctx, +1);
+        }
+        else if (budget.candidates * 2 < 3 * (size_t)ctx.maxKeypoints && budget.smoothedMs < target)
+        {
+            adjustDetectorThreshold(ctx, -1);
+        }
+    }
+
+    addCounter("keypoint_budget", ctx.maxKeypoints);
+    addCounter("frame_time_smoothed_ms", budget.smoothedMs);
+}
@@ -0,0 +1,29 @@
+#ifndef keypointBudget_hpp
+#define keypointBudget_hpp
+
+#include <cstddef>
+
+struct PipelineContext; // matching2D.hpp
+
+
+// State of the feedback controller which keeps the processing time per frame under a deadline. The keypoint
+// limit (PipelineContext::maxKeypoints) follows the measured frame time, the detector threshold keeps
+// enough, but not needlessly many, candidates in front of that limit.
+struct KeypointBudget {
+    bool bEnabled = false;
+    double deadlineMs = 50.0; // processing time per frame to stay under
+    int minKeypoints = 20;    // bounds of the keypoint limit
+    int maxKeypoints = 2000;
+
+    double smoothedMs = 0.0;    // exponential moving average of the frame time
+    std::size_t candidates = 0; // keypoints of the last detection which the limit chose from, 0 -> unknown
+    std::size_t frames = 0;     // no. of frames fed to the controller so far
+};
+
+// Feed the processing time of a frame whose keypoints were detected with the current settings, then adjust
+// ctx.maxKeypoints and the threshold of the configured detector (thresholdFAST, minResponseHarris,
+// qualityLevelShiTomasi) for the next frame. keptKeypoints is the no. of keypoints the frame ended up with.
+// Must be called on the thread which runs the detector.
+void updateKeypointBudget(PipelineContext &ctx, double frameMs, std::size_t keptKeypoints);
+
+#endif /* keypointBudget_hpp */
@@ -0,0 +1,125 @@
+#include <algorithm>
+#include <functional>
+
+#include "keypointSoA.hpp"
+
+using namespace std;
+
+void KeypointSoA::resize(size_t n)
+{
+    x.resize(n);
+    y.resize(n);
+    response.resize(n);
+    size.resize(n);
+    angle.resize(n);
+    octave.resize(n);
+    classId.resize(n);
+}
+
+void KeypointSoA::assign(const vector<cv::KeyPoint> &keypoints)
+{
+    resize(keypoints.size());
+    for (size_t i = 0; i < keypoints.size(); ++i)
+    {
+        const cv::KeyPoint &kpt = keypoints[i];
+        x[i] = kpt.pt.x;
+        y[i] = kpt.pt.y;
+        response[i] = kpt.response;
+        size[i] = kpt.size;
+        angle[i] = kpt.angle;
+        octave[i] = kpt.octave;
+        classId[i] = kpt.class_id;
+    }
+}
+
+void KeypointSoA::toKeyPoints(vector<cv::KeyPoint> &keypoints) const
+{
+    keypoints.resize(count());
+    for (size_t i = 0; i < keypoints.size(); ++i)
+    {
+        cv::KeyPoint &kpt = keypoints[i];
+        kpt.pt = cv::Point2f(x[i], y[i]);
+        kpt.response = response[i];
+        kpt.size = size[i];
+        kpt.angle = angle[i];
+        kpt.octave = octave[i];
+        kpt.class_id = classId[i];
+    }
+}
+
+void KeypointSoA::roiMask(const cv::Rect &rect, vector<uchar> &mask) const
+{
+    int n = (int)count();
+    mask.resize(n);
+    const int x0 = rect.x, x1 = rect.x + rect.width;
+    const int y0 = rect.y, y1 = rect.y + rect.height;
+    const float *px = x.data(), *py = y.data();
+    uchar *m = mask.data();
+
+    // same test as cv::Rect::contains(kpt.pt), which rounds the position to the nearest pixel first;
+    // bitwise & instead of && keeps the loop free of branches
+    for (int i = 0; i < n; ++i)
+    {
+        int xi = cvRound(px[i]), yi = cvRound(py[i]);
+        m[i] = (uchar)((xi >= x0) & (xi < x1) & (yi >= y0) & (yi < y1));
+    }
+}
+
+void KeypointSoA::topKMask(int k, vector<uchar> &mask) const
+{
+    int n = (int)count();
+    if (k < 0 || k >= n)
+    {
+        mask.assign(n, 1);
+        return;
+    }
+    mask.assign(n, 0);
+    if (k == 0)
+    {
+        return;
+    }
+
+    // k-th highest response by partial selection on a copy, O(n)
+    vector<float> &tmp = scratch;
+    tmp.assign(response.begin(), response.end());
+    nth_element(tmp.begin(), tmp.begin() + (k - 1), tmp.end(), greater<float>());
+    const float threshold = tmp[k - 1];
+
+    // everything strictly above the threshold is kept, in one pass
+    const float *r = response.data();
+    uchar *m = mask.data();
+    int nAbove = 0;
+    for (int i = 0; i < n; ++i)
+    {
+        m[i] = (uchar)(r[i] > threshold);
+        nAbove += m[i];
+    }
+
+    // fill up with keypoints exactly at the threshold
+    for (int i = 0; i < n && nAbove < k; ++i)
+    {
+        if (r[i] == threshold)
+        {
+            m[i] = 1;
+            ++nAbove;
+        }
+    }
+}
+
+void KeypointSoA::compact(const vector<uchar> &mask)
+{
+    // branch-free stream compaction: every element is written, the write index only advances for kept ones
+    size_t n = count(), w = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        x[w] = x[i];
+        y[w] = y[i];
+        response[w] = response[i];
+        size[w] = size[i];
+        angle[w] = angle[i];
+        octave[w] = octave[i];
+        classId[w] = classId[i];
+        w += mask[i] != 0;
+    }
+    resize(w);
+}
@@ -0,0 +1,56 @@
+#ifndef keypointSoA_hpp
+#define keypointSoA_hpp
+
+#include <vector>
+#include <cstddef>
+#include <opencv2/core.hpp>
+
+
+// Allocator for the SoA arrays, cv::fastMalloc aligns to 64 bytes so every array starts on a SIMD boundary
+template <typename T>
+struct FastAllocator
+{
+    typedef T value_type;
+
+    FastAllocator() {}
+    template <typename U>
+    FastAllocator(const FastAllocator<U> &) {}
+
+    T *allocate(std::size_t n) { return static_cast<T *>(cv::fastMalloc(n * sizeof(T))); }
+    void deallocate(T *p, std::size_t) { cv::fastFree(p); }
+
+    template <typename U>
+    struct rebind { typedef FastAllocator<U> other; };
+};
+
+template <typename T, typename U>
+bool operator==(const FastAllocator<T> &, const FastAllocator<U> &) { return true; }
+template <typename T, typename U>
+bool operator!=(const FastAllocator<T> &, const FastAllocator<U> &) { return false; }
+
+// Structure-of-arrays keypoint store. The filtering loops only read positions and responses, which are
+// contiguous floats here, so the ROI test and the top-K selection are branch-free loops over plain arrays.
+// Converting from and to std::vector<cv::KeyPoint> happens at the OpenCV boundaries only.
+struct KeypointSoA
+{
+    std::vector<float, FastAllocator<float>> x, y, response, size, angle;
+    std::vector<int, FastAllocator<int>> octave, classId;
+
+    std::size_t count() const { return x.size(); }
+
+    void assign(const std::vector<cv::KeyPoint> &keypoints);
+    void toKeyPoints(std::vector<cv::KeyPoint> &keypoints) const;
+
+    // mask[i] = 1 if keypoint i lies within rect (same test as cv::Rect::contains(kpt.pt), position rounded)
+    void roiMask(const cv::Rect &rect, std::vector<uchar> &mask) const;
+    // mask[i] = 1 for the k keypoints with the highest response (earliest ones win ties), k < 0 keeps all
+    void topKMask(int k, std::vector<uchar> &mask) const;
+    // keep the keypoints with mask[i] != 0, preserving their order
+    void compact(const std::vector<uchar> &mask);
+
+private:
+    void resize(std::size_t n);
+    mutable std::vector<float> scratch; // response copy for the partial selection of topKMask
+};
+
+#endif /* keypointSoA_hpp */
@@ -0,0 +1,76 @@
+#include <vector>
+#include <opencv2/video.hpp>
+
+#include "kltTracker.hpp"
+#include "instrumentation.hpp"
+
+using namespace std;
+
+const vector<cv::Mat> &framePyramid(DataFrame &frame, cv::Size winSize, int maxLevel)
+{
+    if (!frame.bPyramidValid)
+    {
+        ScopedTimer timer("buildOpticalFlowPyramid");
+        cv::buildOpticalFlowPyramid(frame.cameraImg, frame.pyramid, winSize, maxLevel);
+        frame.bPyramidValid = true;
+    }
+    return frame.pyramid;
+}
+
+int trackKeypoints(DataFrame &prevFrame, DataFrame &currFrame, cv::Rect roi, cv::Size winSize, int maxLevel)
+{
+    currFrame.keypoints.clear();
+    currFrame.kptMatches.clear();
+    currFrame.descriptors.release();
+    if (prevFrame.keypoints.empty())
+    {
+        return 0;
+    }
+
+    if (roi.area() == 0)
+    {
+        roi = cv::Rect(0, 0, currFrame.cameraImg.cols, currFrame.cameraImg.rows);
+    }
+
+    // storage is reused from frame to frame
+    thread_local vector<cv::Point2f> prevPts, currPts;
+    thread_local vector<uchar> status;
+    thread_local vector<float> err;
+    thread_local vector<int> srcIdx;
+    cv::KeyPoint::convert(prevFrame.keypoints, prevPts);
+
+    cv::TermCriteria criteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 30, 0.01);
+    const vector<cv::Mat> &prevPyramid = framePyramid(prevFrame, winSize, maxLevel);
+    const vector<cv::Mat> &currPyramid = framePyramid(currFrame, winSize, maxLevel);
+    cv::calcOpticalFlowPyrLK(prevPyramid, currPyramid, prevPts, currPts, status, err,
+                             winSize, maxLevel, criteria);
+
+    // keep the tracked keypoints together with the descriptors they were detected with, so that the next
+    // re-detection can still be matched against this frame
+    srcIdx.clear();
+    for (int i = 0; i < (int)prevPts.size(); ++i)
+    {
+        if (!status[i] || !roi.contains(currPts[i]))
+        {
+            continue;
+        }
+        cv::KeyPoint kpt = prevFrame.keypoints[i];
+        kpt.pt = currPts[i];
+        currFrame.kptMatches.push_back(cv::DMatch(i, (int)currFrame.keypoints.size(), err[i]));
+        currFrame.keypoints.push_back(kpt);
+        srcIdx.push_back(i);
+    }
+
+    if (!prevFrame.descriptors.empty())
+    {
+        currFrame.descriptors.create((int)srcIdx.size(), prevFrame.descriptors.cols, prevFrame.descriptors.type());
+        for (int i = 0; i < (int)srcIdx.size(); ++i)
+        {
+            cv::Mat dst = currFrame.descriptors.row(i);
+            prevFrame.descriptors.row(srcIdx[i]).copyTo(dst);
+        }
+    }
+
+    addCounter("keypoints_tracked", currFrame.keypoints.size());
+    return (int)currFrame.keypoints.size();
+}
@@ -0,0 +1,21 @@
+#ifndef kltTracker_hpp
+#define kltTracker_hpp
+
+#include <vector>
+#include <opencv2/core.hpp>
+
+#include "dataStructures.h"
+
+
+// Propagate the keypoints of prevFrame into currFrame with pyramidal Lucas-Kanade optical flow.
+// Keypoints which are lost or end up outside `roi` (an empty roi means the whole image) are dropped.
+// currFrame receives the tracked keypoints, the descriptor rows of their source keypoints and one match per
+// tracked keypoint (queryIdx into prevFrame, trainIdx into currFrame, distance = LK error), i.e. the same
+// layout as descriptor matching. The image pyramids are cached in the frames, so every frame's pyramid is only
+// built once although it is used as current and then as previous frame. Returns the number of tracked keypoints.
+int trackKeypoints(DataFrame &prevFrame, DataFrame &currFrame, cv::Rect roi, cv::Size winSize, int maxLevel);
+
+// Optical flow pyramid of the frame's image, built if the frame does not hold a valid one yet
+const std::vector<cv::Mat> &framePyramid(DataFrame &frame, cv::Size winSize, int maxLevel);
+
+#endif /* kltTracker_hpp */
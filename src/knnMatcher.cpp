@@ -0,0 +1,118 @@
+#include <algorithm>
+
+#include "knnMatcher.hpp"
+
+using namespace std;
+
+// batchDistance writes Hamming distances as CV_32S, the buffer holds CV_32F for all norms
+static void nearestNeighbours(const cv::Mat &query, const cv::Mat &train, int k, int normType,
+                              cv::Mat &idx, cv::Mat &distance, cv::Mat &distScratch)
+{
+    if (normType == cv::NORM_HAMMING)
+    {
+        cv::batchDistance(query, train, distScratch, CV_32S, idx, normType, k);
+        distScratch.convertTo(distance, CV_32F);
+    }
+    else
+    {
+        cv::batchDistance(query, train, distance, CV_32F, idx, normType, k);
+    }
+}
+
+void knnMatchFlat(const cv::Mat &descSource, const cv::Mat &descRef, int k, int normType, KnnBuffer &knn)
+{
+    if (descSource.empty() || descRef.empty())
+    {
+        knn.trainIdx.create(0, k, CV_32S);
+        knn.distance.create(0, k, CV_32F);
+        return;
+    }
+    nearestNeighbours(descSource, descRef, min(k, descRef.rows), normType, knn.trainIdx, knn.distance, knn.distScratch);
+}
+
+void reverseMatchFlat(const cv::Mat &descSource, const cv::Mat &descRef, int normType, KnnBuffer &knn)
+{
+    if (descSource.empty() || descRef.empty())
+    {
+        knn.reverseIdx.create(0, 1, CV_32S);
+        return;
+    }
+    // the distances are not needed, but batchDistance only returns indices together with them
+    nearestNeighbours(descRef, descSource, 1, normType, knn.reverseIdx, knn.reverseDistance, knn.distScratch);
+}
+
+void filterKnnFlat(KnnBuffer &knn, float ratio, bool bCrossCheck, vector<cv::DMatch> &matches)
+{
+    int rows = knn.trainIdx.rows, k = knn.trainIdx.cols;
+    if (rows == 0 || k < 2)
+    {
+        return; // the ratio test needs a second neighbour
+    }
+    CV_Assert(knn.trainIdx.isContinuous() && knn.distance.isContinuous());
+    CV_Assert(!bCrossCheck || knn.reverseIdx.isContinuous());
+
+    const int *idx = knn.trainIdx.ptr<int>();
+    const float *dist = knn.distance.ptr<float>();
+    vector<uchar> &mask = knn.mask;
+    mask.resize(rows);
+
+    // branch-free over the contiguous buffer, a missing neighbour has index -1
+    int kept = 0;
+    for (int i = 0; i < rows; ++i)
+    {
+        uchar bKeep = (idx[i * k + 1] >= 0) & (dist[i * k] < ratio * dist[i * k + 1]);
+        mask[i] = bKeep;
+        kept += bKeep;
+    }
+    if (bCrossCheck)
+    {
+        const int *reverse = knn.reverseIdx.ptr<int>();
+        kept = 0;
+        for (int i = 0; i < rows; ++i)
+        {
+            mask[i] &= reverse[idx[i * k] >= 0 ? idx[i * k] : 0] == i;
+            kept += mask[i];
+        }
+    }
+
+    matches.reserve(matches.size() + kept);
+    for (int i = 0; i < rows; ++i)
+    {
+        if (mask[i])
+        {
+            matches.push_back(cv::DMatch(i, idx[i * k], dist[i * k]));
+        }
+    }
+}
+
+void filterNearestFlat(KnnBuffer &knn, bool bCrossCheck, vector<cv::DMatch> &matches)
+{
+    int rows = knn.trainIdx.rows, k = knn.trainIdx.cols;
+    if (rows == 0 || k < 1)
+    {
+        return;
+    }
+    CV_Assert(knn.trainIdx.isContinuous() && knn.distance.isContinuous());
+    CV_Assert(!bCrossCheck || knn.reverseIdx.isContinuous());
+
+    const int *idx = knn.trainIdx.ptr<int>();
+    const float *dist = knn.distance.ptr<float>();
+    const int *reverse = bCrossCheck ? knn.reverseIdx.ptr<int>() : nullptr;
+    matches.reserve(matches.size() + rows);
+    for (int i = 0; i < rows; ++i)
+    {
+        int j = idx[i * k];
+        if (j >= 0 && (!reverse || reverse[j] == i))
+        {
+            matches.push_back(cv::DMatch(i, j, dist[i * k]));
+        }
+    }
+}
+
+void crossCheckMatches(vector<cv::DMatch> &matches, const vector<cv::DMatch> &reverse)
+{
+    auto end = remove_if(matches.begin(), matches.end(), [&reverse](const cv::DMatch &m) {
+        return m.trainIdx < 0 || m.trainIdx >= (int)reverse.size() || reverse[m.trainIdx].trainIdx != m.queryIdx;
+    });
+    matches.erase(end, matches.end());
+}
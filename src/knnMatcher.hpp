@@ -0,0 +1,36 @@
+#ifndef knnMatcher_hpp
+#define knnMatcher_hpp
+
+#include <vector>
+#include <opencv2/core.hpp>
+
+
+// k-NN results of all query descriptors in one contiguous query x k layout, instead of one vector per query.
+// The matrices keep their storage from call to call.
+struct KnnBuffer
+{
+    cv::Mat trainIdx;   // CV_32S, one row per query, nearest neighbour first
+    cv::Mat distance;   // CV_32F, same layout
+    cv::Mat reverseIdx; // CV_32S, nearest query of every reference, only filled for the cross-check
+    cv::Mat reverseDistance, distScratch;
+    std::vector<uchar> mask;
+};
+
+// Brute-force k nearest neighbours of every descSource row in descRef (cv::batchDistance, normType NORM_HAMMING
+// for CV_8U or NORM_L2 for CV_32F descriptors). There are fewer than k columns if descRef has fewer than k rows.
+void knnMatchFlat(const cv::Mat &descSource, const cv::Mat &descRef, int k, int normType, KnnBuffer &knn);
+
+// Nearest descSource row of every descRef row into knn.reverseIdx, for filterKnnFlat's cross-check
+void reverseMatchFlat(const cv::Mat &descSource, const cv::Mat &descRef, int normType, KnnBuffer &knn);
+
+// One pass over the k-NN buffer: keep the nearest neighbour if a second one exists and best < ratio * second,
+// and with bCrossCheck only if the query is also the reference's nearest neighbour. Appends to matches.
+void filterKnnFlat(KnnBuffer &knn, float ratio, bool bCrossCheck, std::vector<cv::DMatch> &matches);
+
+// Keep the nearest neighbour of every query (only those which match back with bCrossCheck). Appends to matches.
+void filterNearestFlat(KnnBuffer &knn, bool bCrossCheck, std::vector<cv::DMatch> &matches);
+
+// Drop matches whose reference does not match back to the same query (reverse holds one match per reference)
+void crossCheckMatches(std::vector<cv::DMatch> &matches, const std::vector<cv::DMatch> &reverse);
+
+#endif /* knnMatcher_hpp */
@@ -0,0 +1,173 @@
+#include <stdexcept>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "mappedFile.hpp"
+
+using namespace std;
+
+MappedFile::MappedFile(const string &filename) : ptr(nullptr), length(0)
+{
+#ifdef _WIN32
+    mappingHandle = NULL;
+    fileHandle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    LARGE_INTEGER size;
+    if (fileHandle == INVALID_HANDLE_VALUE || !GetFileSizeEx(fileHandle, &size))
+    {
+        unmap();
+        throw runtime_error("could not open file " + filename);
+    }
+    length = (size_t)size.QuadPart;
+    mappingHandle = length > 0 ? CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+    if (mappingHandle)
+    {
+        ptr = static_cast<const unsigned char *>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+    }
+#else
+    int fd = open(filename.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0)
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        throw runtime_error("could not open file " + filename);
+    }
+    length = (size_t)st.st_size;
+    if (length > 0)
+    {
+        void *p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED)
+        {
+            ptr = static_cast<const unsigned char *>(p);
+            madvise(p, length, MADV_SEQUENTIAL); // files are mostly read front to back, let the kernel read ahead
+        }
+    }
+    close(fd); // the mapping stays valid without the descriptor
+#endif
+
+    if (length > 0 && !ptr)
+    {
+        unmap();
+        throw runtime_error("could not map file " + filename);
+    }
+}
+
+MappedFile::~MappedFile()
+{
+    unmap();
+}
+
+void MappedFile::unmap()
+{
+#ifdef _WIN32
+    if (ptr)
+    {
+        UnmapViewOfFile(ptr);
+    }
+    if (mappingHandle)
+    {
+        CloseHandle(mappingHandle);
+    }
+    if (fileHandle && fileHandle != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(fileHandle);
+    }
+    mappingHandle = NULL;
+    fileHandle = INVALID_HANDLE_VALUE;
+#else
+    if (ptr)
+    {
+        munmap(const_cast<unsigned char *>(ptr), length);
+    }
+#endif
+    ptr = nullptr;
+}
+
+MappedOutputFile::MappedOutputFile(const string &filename, size_t size) : ptr(nullptr), length(size)
+{
+    if (size == 0)
+    {
+        throw invalid_argument("cannot map an empty output file " + filename);
+    }
+#ifdef _WIN32
+    mappingHandle = NULL;
+    fileHandle = CreateFileA(filename.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                             OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (fileHandle == INVALID_HANDLE_VALUE)
+    {
+        unmap();
+        throw runtime_error("could not create file " + filename);
+    }
+    // the mapping grows the file to its size
+    unsigned long long size64 = size;
+    mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READWRITE, (DWORD)(size64 >> 32), (DWORD)size64, NULL);
+    if (mappingHandle)
+    {
+        ptr = static_cast<unsigned char *>(MapViewOfFile(mappingHandle, FILE_MAP_WRITE, 0, 0, size));
+    }
+#else
+    int fd = open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+    {
+        throw runtime_error("could not create file " + filename);
+    }
+    if (ftruncate(fd, (off_t)size) != 0)
+    {
+        close(fd);
+        throw runtime_error("could not resize file " + filename);
+    }
+    void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p != MAP_FAILED)
+    {
+        ptr = static_cast<unsigned char *>(p);
+    }
+    close(fd);
+#endif
+
+    if (!ptr)
+    {
+        unmap();
+        throw runtime_error("could not map file " + filename);
+    }
+}
+
+MappedOutputFile::~MappedOutputFile()
+{
+    unmap();
+}
+
+void MappedOutputFile::unmap()
+{
+#ifdef _WIN32
+    if (ptr)
+    {
+        UnmapViewOfFile(ptr);
+    }
+    if (mappingHandle)
+    {
+        CloseHandle(mappingHandle);
+    }
+    if (fileHandle && fileHandle != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(fileHandle);
+    }
+    mappingHandle = NULL;
+    fileHandle = INVALID_HANDLE_VALUE;
+#else
+    if (ptr)
+    {
+        munmap(ptr, length);
+    }
+#endif
+    ptr = nullptr;
+}
@@ -0,0 +1,57 @@
+#ifndef mappedFile_hpp
+#define mappedFile_hpp
+
+#include <string>
+#include <cstddef>
+
+
+// Read-only memory mapping of a whole file (POSIX mmap or Win32 file mapping), unmapped on destruction
+class MappedFile
+{
+public:
+    // throws if the file cannot be opened or mapped, an empty file gives an empty mapping
+    explicit MappedFile(const std::string &filename);
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const unsigned char *data() const { return ptr; }
+    std::size_t size() const { return length; }
+
+private:
+    void unmap();
+
+    const unsigned char *ptr;
+    std::size_t length;
+#ifdef _WIN32
+    void *fileHandle, *mappingHandle;
+#endif
+};
+
+// Shared read-write mapping of a file of fixed size, the file is created or resized on construction.
+// Other processes mapping the same file see every write without a copy, e.g. a live preview written by the tracker.
+class MappedOutputFile
+{
+public:
+    // throws if the file cannot be created, resized or mapped, size must not be 0
+    MappedOutputFile(const std::string &filename, std::size_t size);
+    ~MappedOutputFile();
+
+    MappedOutputFile(const MappedOutputFile &) = delete;
+    MappedOutputFile &operator=(const MappedOutputFile &) = delete;
+
+    unsigned char *data() { return ptr; }
+    std::size_t size() const { return length; }
+
+private:
+    void unmap();
+
+    unsigned char *ptr;
+    std::size_t length;
+#ifdef _WIN32
+    void *fileHandle, *mappingHandle;
+#endif
+};
+
+#endif /* mappedFile_hpp */
@@ -0,0 +1,192 @@
+#include <new>
+#include <atomic>
+
+#include "matPool.hpp"
+
+using namespace std;
+
+// Round up to the next of four steps per power of two, i.e. at most 25% slack
+static size_t sizeClass(size_t n)
+{
+    if (n <= 64)
+    {
+        return 64;
+    }
+    int bit = 0;
+    while ((n - 1) >> (bit + 1))
+    {
+        ++bit;
+    }
+    size_t step = (size_t)1 << (bit >= 2 ? bit - 2 : 0);
+    return (n + step - 1) / step * step;
+}
+
+PooledMatAllocator::PooledMatAllocator(int maxIdleFrames) : maxIdleFrames(maxIdleFrames)
+{
+}
+
+// Same layout as OpenCV's own CPU allocator, only the buffer and header come from the free lists
+cv::UMatData *PooledMatAllocator::allocate(int dims, const int *sizes, int type, void *data0, size_t *step,
+                                           MatAccessFlag, cv::UMatUsageFlags) const
+{
+    size_t total = CV_ELEM_SIZE(type);
+    for (int i = dims - 1; i >= 0; --i)
+    {
+        if (step)
+        {
+            if (data0 && step[i] != CV_AUTOSTEP)
+            {
+                CV_Assert(total <= step[i]);
+                total = step[i];
+            }
+            else
+            {
+                step[i] = total;
+            }
+        }
+        total *= sizes[i];
+    }
+
+    void *data = data0, *header = nullptr;
+    {
+        lock_guard<mutex> lock(mtx);
+        if (!data0)
+        {
+            ++counts.allocations;
+            auto bin = freeBlocks.find(sizeClass(total));
+            if (bin != freeBlocks.end() && !bin->second.empty())
+            {
+                data = bin->second.back().data;
+                bin->second.pop_back();
+                --counts.cachedBuffers;
+                counts.cachedBytes -= bin->first;
+            }
+            else
+            {
+                ++counts.misses;
+            }
+        }
+        if (!freeHeaders.empty())
+        {
+            header = freeHeaders.back();
+            freeHeaders.pop_back();
+        }
+    }
+
+    if (!data)
+    {
+        data = cv::fastMalloc(sizeClass(total));
+    }
+    if (!header)
+    {
+        header = ::operator new(sizeof(cv::UMatData));
+    }
+    cv::UMatData *u = new (header) cv::UMatData(this);
+    u->data = u->origdata = (uchar *)data;
+    u->size = total;
+    if (data0)
+    {
+        u->flags |= cv::UMatData::USER_ALLOCATED;
+    }
+    return u;
+}
+
+bool PooledMatAllocator::allocate(cv::UMatData *u, MatAccessFlag, cv::UMatUsageFlags) const
+{
+    return u != nullptr;
+}
+
+void PooledMatAllocator::deallocate(cv::UMatData *u) const
+{
+    if (!u)
+    {
+        return;
+    }
+    CV_Assert(u->urefcount == 0);
+    CV_Assert(u->refcount == 0);
+
+    void *data = (u->flags & cv::UMatData::USER_ALLOCATED) ? nullptr : u->origdata;
+    size_t bytes = sizeClass(u->size);
+    u->~UMatData();
+
+    lock_guard<mutex> lock(mtx);
+    freeHeaders.push_back(u);
+    if (data)
+    {
+        if (bReuse)
+        {
+            freeBlocks[bytes].push_back(Block{data, 0});
+            ++counts.cachedBuffers;
+            counts.cachedBytes += bytes;
+        }
+        else
+        {
+            cv::fastFree(data);
+        }
+    }
+}
+
+void PooledMatAllocator::setReuse(bool bReuse)
+{
+    lock_guard<mutex> lock(mtx);
+    this->bReuse = bReuse;
+}
+
+void PooledMatAllocator::endFrame()
+{
+    lock_guard<mutex> lock(mtx);
+    for (auto bin = freeBlocks.begin(); bin != freeBlocks.end(); ++bin)
+    {
+        vector<Block> &blocks = bin->second;
+        size_t kept = 0;
+        for (size_t i = 0; i < blocks.size(); ++i)
+        {
+            if (!bReuse || ++blocks[i].idleFrames > maxIdleFrames)
+            {
+                cv::fastFree(blocks[i].data);
+                --counts.cachedBuffers;
+                counts.cachedBytes -= bin->first;
+            }
+            else
+            {
+                blocks[kept++] = blocks[i];
+            }
+        }
+        blocks.resize(kept); // shrinking keeps the capacity, so the bin does not reallocate next frame
+    }
+}
+
+MatPoolStats PooledMatAllocator::stats() const
+{
+    lock_guard<mutex> lock(mtx);
+    return counts;
+}
+
+// Mats may outlive main (static Mats, detached threads), so the pool they return their buffers to is never destroyed
+static PooledMatAllocator *pool = new PooledMatAllocator();
+static atomic<bool> bPoolEnabled(false);
+
+void enableMatPool(bool bReuse)
+{
+    pool->setReuse(bReuse);
+    cv::Mat::setDefaultAllocator(pool);
+    bPoolEnabled = true;
+}
+
+bool matPoolEnabled()
+{
+    return bPoolEnabled;
+}
+
+void matPoolEndFrame()
+{
+    if (bPoolEnabled)
+    {
+        pool->endFrame();
+    }
+}
+
+MatPoolStats matPoolStats()
+{
+    return pool->stats();
+}
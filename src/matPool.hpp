@@ -0,0 +1,65 @@
+#ifndef matPool_hpp
+#define matPool_hpp
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+#include <unordered_map>
+#include <opencv2/core.hpp>
+
+#if CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR < 1
+typedef int MatAccessFlag; // before OpenCV 4.1 the access flags were plain ints
+#else
+typedef cv::AccessFlag MatAccessFlag;
+#endif
+
+
+struct MatPoolStats {
+    std::size_t allocations = 0;   // Mat buffers handed out
+    std::size_t misses = 0;        // ... of which had to be allocated from the heap
+    std::size_t cachedBuffers = 0; // buffers currently waiting for reuse
+    std::size_t cachedBytes = 0;
+};
+
+// cv::MatAllocator which keeps released buffers and their UMatData headers for reuse. Buffers are binned into
+// size classes of at most 25% slack, so frames whose images and descriptor matrices have about the same size
+// are served from the buffers the previous frames released, without touching the heap. endFrame() frees
+// buffers nobody asked for during the last maxIdleFrames frames, which bounds the memory held by the pool.
+class PooledMatAllocator : public cv::MatAllocator
+{
+public:
+    explicit PooledMatAllocator(int maxIdleFrames = 2);
+
+    cv::UMatData *allocate(int dims, const int *sizes, int type, void *data, size_t *step,
+                           MatAccessFlag flags, cv::UMatUsageFlags usageFlags) const override;
+    bool allocate(cv::UMatData *u, MatAccessFlag accessFlags, cv::UMatUsageFlags usageFlags) const override;
+    void deallocate(cv::UMatData *u) const override;
+
+    void setReuse(bool bReuse); // false -> release every buffer right away, only count allocations
+    void endFrame();
+    MatPoolStats stats() const;
+
+private:
+    struct Block {
+        void *data;
+        int idleFrames;
+    };
+
+    int maxIdleFrames;
+    bool bReuse = true;
+    mutable std::mutex mtx;
+    mutable std::unordered_map<std::size_t, std::vector<Block>> freeBlocks; // by size class
+    mutable std::vector<void *> freeHeaders;                               // storage for UMatData
+    mutable MatPoolStats counts;
+};
+
+// Make the pool the default allocator of every cv::Mat allocated from now on, in all threads.
+// bReuse = false keeps the allocation counters but releases buffers immediately, for comparison.
+void enableMatPool(bool bReuse = true);
+bool matPoolEnabled();
+
+// Called once per processed frame, after the frame's temporaries have been released (no-op if not enabled)
+void matPoolEndFrame();
+MatPoolStats matPoolStats();
+
+#endif /* matPool_hpp */
@@ -17,13 +17,102 @@
 #include <opencv2/xfeatures2d/nonfree.hpp>
 
 #include "dataStructures.h"
+#include "knnMatcher.hpp"
+#include "keypointBudget.hpp"
 
+// Stage algorithms resolved once from the configured type names, so the per-frame dispatch is a switch
+enum class DetectorKind { SHITOMASI, HARRIS, FAST, BRISK, ORB, AKAZE, SIFT, UNKNOWN };
+enum class MatcherKind { BF, FLANN, HAMMING, UNKNOWN };
+enum class SelectorKind { NN, KNN, UNKNOWN };
 
-void detKeypointsHarris(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis);
-void detKeypointsShiTomasi(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis);
-void detKeypointsModern(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, std::string detectorType, bool bVis);
-void descKeypoints(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, cv::Mat &descriptors, std::string descriptorType);
-void matchDescriptors(std::vector<cv::KeyPoint> &kPtsSource, std::vector<cv::KeyPoint> &kPtsRef, cv::Mat &descSource, cv::Mat &descRef,
+DetectorKind parseDetectorKind(const std::string &detectorType);
+MatcherKind parseMatcherKind(const std::string &matcherType);
+SelectorKind parseSelectorKind(const std::string &selectorType);
+
+// Detector, extractor and matcher built once from the configured type names and reused for every frame
+struct PipelineContext
+{
+    std::string detectorType;    // SHITOMASI, HARRIS, FAST, BRISK, ORB, AKAZE, SIFT
+    std::string descriptorType;  // BRISK, ORB, AKAZE, FREAK, SIFT
+    std::string matcherType;     // MAT_BF, MAT_FLANN, MAT_HAMMING
+    std::string descriptorClass; // DES_BINARY, DES_HOG
+    std::string selectorType;    // SEL_NN, SEL_KNN
+    DetectorKind detectorKind = DetectorKind::UNKNOWN;
+    MatcherKind matcherKind = MatcherKind::UNKNOWN;
+    SelectorKind selectorKind = SelectorKind::UNKNOWN;
+    bool bBinaryDescriptors = true; // descriptorClass is DES_BINARY -> Hamming norm, L2 otherwise
+
+    int thresholdFAST = 80; // FAST intensity threshold, read when the detector is created
+    float ratio = 0.8f;     // descriptor distance ratio of the SEL_KNN test
+    int minResponseHarris = 120;        // HARRIS corner threshold in the 8bit scaled response
+    double qualityLevelShiTomasi = 0.01; // SHITOMASI corner threshold relative to the strongest corner
+    int maxKeypoints = 50;              // keypoint limit of the next frame
+    KeypointBudget budget;              // adjusts the three above and thresholdFAST from frame to frame
+
+    cv::Ptr<cv::FeatureDetector> detector; // empty for SHITOMASI and HARRIS
+    cv::Ptr<cv::DescriptorExtractor> extractor;
+    cv::Ptr<cv::DescriptorMatcher> matcher;
+    bool bGridNMS = true;     // grid-based Harris NMS, false -> original O(n^2) loop
+    bool bFusedHarris = true; // single-pass Harris kernel with reused buffers, false -> cv::cornerHarris + normalize
+
+    bool bCrossCheck = false; // only keep matches whose reference matches back to the same source descriptor
+
+    std::vector<std::vector<cv::DMatch>> knnMatches; // scratch buffer for SEL_KNN with MAT_FLANN and on the device
+    KnnBuffer knnBuffer;                               // scratch buffer for SEL_KNN with MAT_BF
+    cv::Mat stackedDescriptors;                        // scratch buffer for batched matching against several frames
+    std::vector<std::vector<cv::DMatch>> batchMatches; // scratch buffer for batched matching, one list per frame
+
+    // spatially gated matching
+    bool bGatedMatching = false; // only compare keypoints within gateRadius of their predicted position
+    float gateRadius = 40.0f;    // search radius in pixels
+    bool bPredictMotion = true;  // shift the gate by the median keypoint motion of the last matched frame pair
+    cv::Point2f predictedMotion = cv::Point2f(0.0f, 0.0f);
+
+    // OpenCL backend (transparent API)
+    bool bUseOpenCL = false;      // modern detectors, extractors and the BF matcher run on cv::UMat
+    bool bHostDescriptors = true; // also download descriptors, as some enabled stage needs them on the host
+    double transferMs = 0.0;      // accumulated host <-> device copy time
+
+    // KLT tracking state
+    int framesSinceDetection = 0; // no. of frames tracked since the last full detection
+};
+
+cv::Ptr<cv::FeatureDetector> createDetector(std::string detectorType, int thresholdFAST = 80);
+cv::Ptr<cv::DescriptorExtractor> createExtractor(std::string descriptorType);
+cv::Ptr<cv::DescriptorMatcher> createMatcher(std::string matcherType, std::string descriptorClass);
+// builds the stage objects with the parameters already set on ctx (thresholdFAST)
+void initPipelineContext(PipelineContext &ctx, std::string detectorType, std::string descriptorType,
+                         std::string matcherType, std::string descriptorClass, std::string selectorType);
+
+
+void detKeypointsHarris(std::vector<cv::KeyPoint> &keypoints, const cv::Mat &img, bool bVis, bool bGridNMS = true, int minResponse = 120);
+void detKeypointsHarrisFused(std::vector<cv::KeyPoint> &keypoints, const cv::Mat &img, bool bVis, bool bGridNMS = true, int minResponse = 120);
+void detKeypointsShiTomasi(std::vector<cv::KeyPoint> &keypoints, const cv::Mat &img, bool bVis, double qualityLevel = 0.01);
+void detKeypointsModern(std::vector<cv::KeyPoint> &keypoints, const cv::Mat &img, std::string detectorType, bool bVis);
+void descKeypoints(std::vector<cv::KeyPoint> &keypoints, const cv::Mat &img, cv::Mat &descriptors, std::string descriptorType);
+void matchDescriptors(const std::vector<cv::KeyPoint> &kPtsSource, const std::vector<cv::KeyPoint> &kPtsRef, const cv::Mat &descSource, const cv::Mat &descRef,
                       std::vector<cv::DMatch> &matches, std::string descriptorType, std::string matcherType, std::string selectorType);
 
+void detKeypointsModern(std::vector<cv::KeyPoint> &keypoints, const cv::Mat &img, PipelineContext &ctx, bool bVis);
+void detKeypoints(std::vector<cv::KeyPoint> &keypoints, const cv::Mat &img, PipelineContext &ctx, bool bVis);
+void detKeypointsRoi(std::vector<cv::KeyPoint> &keypoints, const cv::Mat &img, cv::Rect roi, PipelineContext &ctx, bool bVis);
+int detectorBorder(std::string detectorType);
+int detectorBorder(DetectorKind detectorKind);
+void limitKeypoints(std::vector<cv::KeyPoint> &keypoints, int maxKeypoints, bool bByResponse, bool bAnms);
+bool supportsTiledDetection(std::string detectorType);
+bool supportsTiledDetection(DetectorKind detectorKind);
+std::size_t detKeypointsTiled(std::vector<cv::KeyPoint> &keypoints, const cv::Mat &img, cv::Rect area, PipelineContext &ctx,
+                              cv::Size tileGrid, int maxKeypoints);
+void descKeypoints(std::vector<cv::KeyPoint> &keypoints, const cv::Mat &img, cv::Mat &descriptors, PipelineContext &ctx);
+bool supportsDetectAndCompute(const PipelineContext &ctx);
+bool supportsDeviceMatching(const PipelineContext &ctx);
+void detKeypointsDevice(std::vector<cv::KeyPoint> &keypoints, const cv::UMat &img, cv::Rect roi, PipelineContext &ctx);
+void descKeypoints(std::vector<cv::KeyPoint> &keypoints, const cv::UMat &img, cv::UMat &descriptors, PipelineContext &ctx);
+void matchDescriptors(const cv::UMat &descSource, const cv::UMat &descRef, std::vector<cv::DMatch> &matches, PipelineContext &ctx);
+void detDescKeypoints(std::vector<cv::KeyPoint> &keypoints, cv::Mat &descriptors, const cv::Mat &img, cv::Rect roi, PipelineContext &ctx);
+void matchDescriptors(const std::vector<cv::KeyPoint> &kPtsSource, const std::vector<cv::KeyPoint> &kPtsRef, const cv::Mat &descSource, const cv::Mat &descRef,
+                      std::vector<cv::DMatch> &matches, PipelineContext &ctx);
+void matchDescriptorsIndexed(const cv::Mat &descQuery, DescriptorIndex &refIndex, DescriptorIndex *queryIndex,
+                             std::vector<cv::DMatch> &matches, PipelineContext &ctx);
+
 #endif /* matching2D_hpp */
@@ -1,11 +1,17 @@
 #include <numeric>
+#include <algorithm>
 #include "matching2D.hpp"
+#include "instrumentation.hpp"
+#include "hammingMatcher.hpp"
+#include "gatedMatcher.hpp"
+#include "knnMatcher.hpp"
+#include "descriptorIndex.hpp"
 
 using namespace std;
 
-// Find best matches for keypoints in two camera images based on several matching methods
-void matchDescriptors(std::vector<cv::KeyPoint> &kPtsSource, std::vector<cv::KeyPoint> &kPtsRef, cv::Mat &descSource, cv::Mat &descRef,
-                      std::vector<cv::DMatch> &matches, std::string descriptorType, std::string matcherType, std::string selectorType)
+// Create the matcher for the given matcher type (MAT_BF, MAT_FLANN) and descriptor class (DES_BINARY, DES_HOG),
+// MAT_HAMMING uses the built-in popcount kernel and needs no OpenCV matcher object
+cv::Ptr<cv::DescriptorMatcher> createMatcher(std::string matcherType, std::string descriptorClass)
 {
     // configure matcher
     bool crossCheck = false;
@@ -13,44 +19,194 @@ void matchDescriptors(std::vector<cv::KeyPoint> &kPtsSource, std::vector<cv::Key
 
     if (matcherType.compare("MAT_BF") == 0)
     {
-        int normType = descriptorType.compare("DES_BINARY") == 0 ? cv::NORM_HAMMING : cv::NORM_L2;
+        int normType = descriptorClass.compare("DES_BINARY") == 0 ? cv::NORM_HAMMING : cv::NORM_L2;
         matcher = cv::BFMatcher::create(normType, crossCheck);
     }
     else if (matcherType.compare("MAT_FLANN") == 0)
     {
-		// OpenCV bug workaround : convert binary descriptors to floating point due to a bug in current OpenCV implementation
-		if (descSource.type() != CV_32F || descRef.type() != CV_32F) {
-			descSource.convertTo(descSource, CV_32F);
-			descRef.convertTo(descRef, CV_32F);
+		if (descriptorClass.compare("DES_BINARY") == 0) {
+			// LSH index works directly on the CV_8U descriptors with Hamming distance
+			int tableNumber = 12;    // no. of hash tables
+			int keySize = 20;        // length of the hash key in bits
+			int multiProbeLevel = 2; // no. of neighbouring buckets probed per table
+			matcher = cv::makePtr<cv::FlannBasedMatcher>(cv::makePtr<cv::flann::LshIndexParams>(tableNumber, keySize, multiProbeLevel));
+		}
+		else {
+			matcher = cv::FlannBasedMatcher::create(); // KD-tree index for floating point descriptors
 		}
-
-		matcher = cv::FlannBasedMatcher::create();
-		//matcher = cv::DescriptorMatcher::create(cv::DescriptorMatcher::FLANNBASED);
     }
+    return matcher;
+}
 
-    // perform matching task
-    if (selectorType.compare("SEL_NN") == 0)
-    { // nearest neighbor (best match)
+// Keep the best of two neighbours if it passes the descriptor distance ratio test
+// (LSH may find fewer than two neighbours, the ratio test is undefined for those)
+static void filterRatioTest(const vector<vector<cv::DMatch>> &knn_matches, float ratio, std::vector<cv::DMatch> &matches)
+{
+	for (auto it = knn_matches.begin(); it != knn_matches.end(); ++it) {
+		if (it->size() >= 2 && (*it)[0].distance < ratio*((*it)[1].distance)) {
+			matches.push_back((*it)[0]);
+		}
+	}
+	addCounter("matches_after_ratio_test", matches.size());
+}
 
-        matcher->match(descSource, descRef, matches); // Finds the best match for each descriptor in desc1
+// Run the matching task on the matcher configured in ctx, using its scratch buffers
+static void matchDescriptorsHost(PipelineContext &ctx, const cv::Mat &descSource, const cv::Mat &descRef, std::vector<cv::DMatch> &matches)
+{
+    ScopedTimer timer("matchDescriptors");
+    if (descSource.empty() || descRef.empty())
+    { // a frame without keypoints has nothing to match, the FLANN index cannot even be built on it
+        addCounter("matches", 0);
+        return;
     }
-    else if (selectorType.compare("SEL_KNN") == 0)
-    { // k nearest neighbors (k=2)
-		vector<vector<cv::DMatch>> knn_matches;
-		matcher->knnMatch(descSource, descRef, knn_matches, 2);
-
-		// filter matches using descriptor distance ratio test
-		double min_desc_dist_ratio = 0.8;
-		for (auto it = knn_matches.begin(); it != knn_matches.end(); ++it) {
-			if ((*it)[0].distance < min_desc_dist_ratio*((*it)[1].distance)) {
-				matches.push_back((*it)[0]);
-			}
+    cv::Mat querySource = descSource, queryRef = descRef;
+    if (ctx.matcherKind == MatcherKind::FLANN && !ctx.bBinaryDescriptors)
+    {
+		// the KD-tree index needs floating point descriptors, convert into temporaries so the frames' descriptors stay untouched
+		if (descSource.type() != CV_32F) {
+			descSource.convertTo(querySource, CV_32F);
 		}
+		if (descRef.type() != CV_32F) {
+			descRef.convertTo(queryRef, CV_32F);
+		}
+    }
+
+    // the flat k-NN buffer applies the cross-check together with the ratio test, all other paths afterwards
+    bool bFlatKnn = ctx.matcherKind == MatcherKind::BF && ctx.selectorKind == SelectorKind::KNN;
+    if (ctx.matcherKind == MatcherKind::HAMMING)
+    { // SIMD popcount brute force, the ratio test is applied while searching
+        switch (ctx.selectorKind)
+        {
+        case SelectorKind::NN:
+            matchHammingNN(descSource, descRef, matches);
+            break;
+        case SelectorKind::KNN:
+            matchHammingKnnRatio(descSource, descRef, matches, ctx.ratio);
+            addCounter("matches_after_ratio_test", matches.size());
+            break;
+        default:
+            break;
+        }
+    }
+    else
+    {
+        // perform matching task
+        switch (ctx.selectorKind)
+        {
+        case SelectorKind::NN: // nearest neighbor (best match)
+            ctx.matcher->match(querySource, queryRef, matches); // Finds the best match for each descriptor in desc1
+            break;
+        case SelectorKind::KNN: // k nearest neighbors (k=2)
+            if (bFlatKnn) {
+                // one query x 2 buffer instead of a result vector per query
+                int normType = ctx.bBinaryDescriptors ? cv::NORM_HAMMING : cv::NORM_L2;
+                knnMatchFlat(descSource, descRef, 2, normType, ctx.knnBuffer);
+                if (ctx.bCrossCheck) {
+                    reverseMatchFlat(descSource, descRef, normType, ctx.knnBuffer);
+                }
+                filterKnnFlat(ctx.knnBuffer, ctx.ratio, ctx.bCrossCheck, matches);
+                addCounter("matches_after_ratio_test", matches.size());
+            }
+            else {
+                // the FLANN index only returns per-query result lists
+                ctx.knnMatches.clear();
+                ctx.matcher->knnMatch(querySource, queryRef, ctx.knnMatches, 2);
+                filterRatioTest(ctx.knnMatches, ctx.ratio, matches);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (ctx.bCrossCheck && !bFlatKnn)
+    {
+        thread_local vector<cv::DMatch> reverse; // storage is reused from frame to frame
+        reverse.clear();
+        if (ctx.matcherKind == MatcherKind::HAMMING) {
+            matchHammingNN(descRef, descSource, reverse);
+        }
+        else {
+            ctx.matcher->match(queryRef, querySource, reverse);
+        }
+        crossCheckMatches(matches, reverse);
+        addCounter("matches_after_cross_check", matches.size());
     }
+    addCounter("matches", matches.size());
 }
 
-// Use one of several types of state-of-art descriptors to uniquely identify keypoints
-void descKeypoints(vector<cv::KeyPoint> &keypoints, cv::Mat &img, cv::Mat &descriptors, string descriptorType)
+// Find best matches for keypoints in two camera images based on several matching methods
+void matchDescriptors(const std::vector<cv::KeyPoint> &kPtsSource, const std::vector<cv::KeyPoint> &kPtsRef, const cv::Mat &descSource, const cv::Mat &descRef,
+                      std::vector<cv::DMatch> &matches, std::string descriptorType, std::string matcherType, std::string selectorType)
+{
+    // matcher only, descriptorType takes the place of the descriptor class; the kinds and the matcher are resolved
+    // once per thread and kept while the same types are asked for, like the pipeline's context
+    thread_local PipelineContext ctx;
+    thread_local bool bInitialized = false;
+    if (!bInitialized || ctx.matcherType.compare(matcherType) != 0 || ctx.descriptorClass.compare(descriptorType) != 0 ||
+        ctx.selectorType.compare(selectorType) != 0)
+    {
+        initPipelineContext(ctx, "", "", matcherType, descriptorType, selectorType);
+        bInitialized = true;
+    }
+    matchDescriptorsHost(ctx, descSource, descRef, matches);
+}
+
+// Same as above, but reuses the matcher and scratch buffers held by the pipeline context
+void matchDescriptors(const std::vector<cv::KeyPoint> &kPtsSource, const std::vector<cv::KeyPoint> &kPtsRef, const cv::Mat &descSource, const cv::Mat &descRef,
+                      std::vector<cv::DMatch> &matches, PipelineContext &ctx)
+{
+    if (ctx.bGatedMatching)
+    { // only compare against reference keypoints close to the predicted position
+        ScopedTimer timer("matchDescriptorsGated");
+        int normType = ctx.bBinaryDescriptors ? cv::NORM_HAMMING : cv::NORM_L2;
+        cv::Point2f offset = ctx.bPredictMotion ? ctx.predictedMotion : cv::Point2f(0.0f, 0.0f);
+        matchDescriptorsGated(kPtsSource, kPtsRef, descSource, descRef, matches, normType, ctx.selectorType,
+                              ctx.gateRadius, offset, ctx.ratio);
+        if (ctx.bPredictMotion)
+        {
+            ctx.predictedMotion = medianDisplacement(kPtsSource, kPtsRef, matches);
+        }
+        addCounter("matches", matches.size());
+        return;
+    }
+
+    matchDescriptorsHost(ctx, descSource, descRef, matches);
+}
+
+// MAT_FLANN on prebuilt indexes: every descQuery row is looked up in refIndex (queryIdx -> descQuery, trainIdx -> refIndex).
+// The cross-check searches queryIndex, the index over descQuery itself, with the reference rows; nullptr skips it.
+void matchDescriptorsIndexed(const cv::Mat &descQuery, DescriptorIndex &refIndex, DescriptorIndex *queryIndex,
+                             std::vector<cv::DMatch> &matches, PipelineContext &ctx)
+{
+    ScopedTimer timer("matchDescriptorsIndexed");
+    KnnBuffer &knn = ctx.knnBuffer;
+    bool bCrossCheck = ctx.bCrossCheck && queryIndex;
+    if (bCrossCheck)
+    {
+        knnSearchIndex(*queryIndex, refIndex.descriptors, 1, knn);
+        std::swap(knn.trainIdx, knn.reverseIdx); // nearest query row of every reference row
+    }
+
+    switch (ctx.selectorKind)
+    {
+    case SelectorKind::NN:
+        knnSearchIndex(refIndex, descQuery, 1, knn);
+        filterNearestFlat(knn, bCrossCheck, matches);
+        break;
+    case SelectorKind::KNN:
+        knnSearchIndex(refIndex, descQuery, 2, knn);
+        filterKnnFlat(knn, ctx.ratio, bCrossCheck, matches);
+        addCounter("matches_after_ratio_test", matches.size());
+        break;
+    default:
+        break;
+    }
+    addCounter("matches", matches.size());
+}
+
+// Create one of several types of state-of-art descriptor extractors
+cv::Ptr<cv::DescriptorExtractor> createExtractor(std::string descriptorType)
 {
     // select appropriate descriptor
     cv::Ptr<cv::DescriptorExtractor> extractor;
@@ -82,29 +238,111 @@ void descKeypoints(vector<cv::KeyPoint> &keypoints, cv::Mat &img, cv::Mat &descr
 	else {
 		// Do Nothing
 	}
+    return extractor;
+}
 
-    // perform feature description
-    double t = (double)cv::getTickCount();
+// perform feature description with an already configured extractor
+static void descKeypoints(cv::Ptr<cv::DescriptorExtractor> &extractor, vector<cv::KeyPoint> &keypoints, const cv::Mat &img, cv::Mat &descriptors, string descriptorType)
+{
+    ScopedTimer timer("descKeypoints");
     extractor->compute(img, keypoints, descriptors);
-    t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
-    cout << descriptorType << " descriptor extraction in " << 1000 * t / 1.0 << " ms" << endl;
+    if (stageLoggingEnabled())
+    {
+        cout << descriptorType << " descriptor extraction in " << timer.elapsedMs() << " ms\n";
+    }
+}
+
+// Use one of several types of state-of-art descriptors to uniquely identify keypoints
+void descKeypoints(vector<cv::KeyPoint> &keypoints, const cv::Mat &img, cv::Mat &descriptors, string descriptorType)
+{
+    cv::Ptr<cv::DescriptorExtractor> extractor = createExtractor(descriptorType);
+    descKeypoints(extractor, keypoints, img, descriptors, descriptorType);
+}
+
+// Same as above, but reuses the extractor held by the pipeline context
+void descKeypoints(vector<cv::KeyPoint> &keypoints, const cv::Mat &img, cv::Mat &descriptors, PipelineContext &ctx)
+{
+    descKeypoints(ctx.extractor, keypoints, img, descriptors, ctx.descriptorType);
+}
+
+// Resolve the type names once, UNKNOWN for names no stage implements
+DetectorKind parseDetectorKind(const std::string &detectorType)
+{
+    static const char *names[] = {"SHITOMASI", "HARRIS", "FAST", "BRISK", "ORB", "AKAZE", "SIFT"}; // in DetectorKind order
+    for (int i = 0; i < (int)(sizeof(names) / sizeof(names[0])); ++i)
+    {
+        if (detectorType.compare(names[i]) == 0)
+        {
+            return (DetectorKind)i;
+        }
+    }
+    return DetectorKind::UNKNOWN;
+}
+
+MatcherKind parseMatcherKind(const std::string &matcherType)
+{
+    if (matcherType.compare("MAT_BF") == 0)
+    {
+        return MatcherKind::BF;
+    }
+    else if (matcherType.compare("MAT_FLANN") == 0)
+    {
+        return MatcherKind::FLANN;
+    }
+    else if (matcherType.compare("MAT_HAMMING") == 0)
+    {
+        return MatcherKind::HAMMING;
+    }
+    return MatcherKind::UNKNOWN;
+}
+
+SelectorKind parseSelectorKind(const std::string &selectorType)
+{
+    if (selectorType.compare("SEL_NN") == 0)
+    {
+        return SelectorKind::NN;
+    }
+    else if (selectorType.compare("SEL_KNN") == 0)
+    {
+        return SelectorKind::KNN;
+    }
+    return SelectorKind::UNKNOWN;
+}
+
+// Build the detector, extractor and matcher objects once so they can be reused for every frame
+void initPipelineContext(PipelineContext &ctx, std::string detectorType, std::string descriptorType,
+                         std::string matcherType, std::string descriptorClass, std::string selectorType)
+{
+    ctx.detectorType = detectorType;
+    ctx.descriptorType = descriptorType;
+    ctx.matcherType = matcherType;
+    ctx.descriptorClass = descriptorClass;
+    ctx.selectorType = selectorType;
+    ctx.detectorKind = parseDetectorKind(detectorType);
+    ctx.matcherKind = parseMatcherKind(matcherType);
+    ctx.selectorKind = parseSelectorKind(selectorType);
+    ctx.bBinaryDescriptors = descriptorClass.compare("DES_BINARY") == 0;
+
+    ctx.detector = createDetector(detectorType, ctx.thresholdFAST);
+    ctx.extractor = createExtractor(descriptorType);
+    ctx.matcher = createMatcher(matcherType, descriptorClass);
+    ctx.knnMatches.clear();
 }
 
 // Detect keypoints in image using the traditional Shi-Thomasi detector
-void detKeypointsShiTomasi(vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis = false)
+void detKeypointsShiTomasi(vector<cv::KeyPoint> &keypoints, const cv::Mat &img, bool bVis, double qualityLevel)
 {
     // compute detector parameters based on image size
     int blockSize = 4;       //  size of an average block for computing a derivative covariation matrix over each pixel neighborhood
     double maxOverlap = 0.0; // max. permissible overlap between two features in %
     double minDistance = (1.0 - maxOverlap) * blockSize;
     int maxCorners = img.rows * img.cols / max(1.0, minDistance); // max. num. of keypoints
-
-    double qualityLevel = 0.01; // minimal accepted quality of image corners
+    // qualityLevel: minimal accepted quality of image corners
     double k = 0.04;
 
     // Apply corner detection
-    double t = (double)cv::getTickCount();
-    vector<cv::Point2f> corners;
+    ScopedTimer timer("detKeypointsShiTomasi");
+    thread_local vector<cv::Point2f> corners; // storage is reused from frame to frame
     cv::goodFeaturesToTrack(img, corners, maxCorners, qualityLevel, minDistance, cv::Mat(), blockSize, false, k);
 
     // add corners to result vector
@@ -116,8 +354,11 @@ void detKeypointsShiTomasi(vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool b
         newKeyPoint.size = blockSize;
         keypoints.push_back(newKeyPoint);
     }
-    t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
-    cout << "Shi-Tomasi detection with n=" << keypoints.size() << " keypoints in " << 1000 * t / 1.0 << " ms" << endl;
+    addCounter("keypoints_detected", keypoints.size());
+    if (stageLoggingEnabled())
+    {
+        cout << "Shi-Tomasi detection with n=" << keypoints.size() << " keypoints in " << timer.elapsedMs() << " ms\n";
+    }
 
     // visualize results
     if (bVis)
@@ -130,31 +371,14 @@ void detKeypointsShiTomasi(vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool b
     }
 }
 
-void detKeypointsHarris(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis = false)
+// Harris NMS reference implementation: every candidate is checked against every keypoint accepted so far.
+// The 8bit scaled response is dst_norm * scale + shift, both NMS variants take the raw Harris response with the
+// min/max normalization given explicitly, so the fused kernel does not need a separately normalized image.
+static void nmsHarrisBruteForce(const cv::Mat &dst_norm, double scale, double shift, int minResponse, int apertureSize, double maxOverlap, std::vector<cv::KeyPoint> &keypoints)
 {
-	int blockSize = 2; // size of neighbourhood considered for corner detection
-	int apertureSize = 3;// Aperture parameter for the Sobel() operator
-	double k = 0.04; // Harris detector free parameter
-	int borderType = cv::BORDER_DEFAULT; // Pixel extrapolation methods
-	int minResponse = 120; // minimum value for a corner in the 8bit scaled response matrix
-
-	double t = (double)cv::getTickCount();
-	cv::Mat dst, dst_norm, dst_norm_scaled;
-	dst = cv::Mat::zeros(img.size(), CV_32FC1);
-	cv::cornerHarris(img, dst, blockSize, apertureSize, k, borderType);
-	cv::normalize(dst, dst_norm, 0, 255, cv::NORM_MINMAX, CV_32FC1, cv::Mat());
-	cv::convertScaleAbs(dst_norm, dst_norm_scaled);
-	
-	// Locate local maxima in the Harris response matrix 
-	// and perform a non-maximum suppression (NMS) in a local neighborhood around 
-	// each maximum. The resulting coordinates shall be stored in a list of keypoints 
-	// of the type `vector<cv::KeyPoint>`.
-
-	double maxOverlap = 0.0; // max permissible overlap between two features in %, used during non-maxima suppression
-
 	for (std::size_t i = 0; i < dst_norm.rows; ++i) {
 		for (std::size_t j = 0; j < dst_norm.cols; ++j) {
-			int response = (int)dst_norm.at<float>(i, j);
+			int response = (int)(float)(dst_norm.at<float>(i, j) * scale + shift);
 			if (response > minResponse) {
 				// only store points above a threshold
 				cv::KeyPoint newKeyPoint;
@@ -183,8 +407,97 @@ void detKeypointsHarris(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool
 			}
 		}
 	}
-	t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
-	cout << "Harris detection with n=" << keypoints.size() << " keypoints in " << 1000 * t / 1.0 << " ms" << endl;
+}
+
+// Harris NMS on a uniform grid: all keypoints have size 2*apertureSize, so two of them can only overlap
+// if their centres lie in neighbouring cells of that size. Produces the same keypoints as nmsHarrisBruteForce.
+static void nmsHarrisGrid(const cv::Mat &dst_norm, double scale, double shift, int minResponse, int apertureSize, double maxOverlap, std::vector<cv::KeyPoint> &keypoints)
+{
+	int cellSize = 2 * apertureSize;
+	int gridCols = (dst_norm.cols + cellSize - 1) / cellSize;
+	int gridRows = (dst_norm.rows + cellSize - 1) / cellSize;
+	std::vector<std::vector<int>> grid(gridCols * gridRows); // indices into keypoints, bucketed by cell
+
+	for (int i = 0; i < dst_norm.rows; ++i) {
+		const float *row = dst_norm.ptr<float>(i);
+		for (int j = 0; j < dst_norm.cols; ++j) {
+			int response = (int)(float)(row[j] * scale + shift);
+			if (response > minResponse) {
+				cv::KeyPoint newKeyPoint;
+				newKeyPoint.pt = cv::Point2f(j, i);
+				newKeyPoint.size = 2 * apertureSize;
+				newKeyPoint.response = response;
+
+				// the brute-force loop replaces the first overlapping keypoint (in list order) with a lower response,
+				// so look for the smallest such index among the neighbouring cells
+				int cx = j / cellSize, cy = i / cellSize;
+				bool bOverlap = false;
+				int replaceIdx = -1;
+				for (int gy = max(0, cy - 1); gy <= min(gridRows - 1, cy + 1); ++gy) {
+					for (int gx = max(0, cx - 1); gx <= min(gridCols - 1, cx + 1); ++gx) {
+						const std::vector<int> &cell = grid[gy * gridCols + gx];
+						for (auto it = cell.begin(); it != cell.end(); ++it) {
+							const cv::KeyPoint &kpt = keypoints[*it];
+							if (cv::KeyPoint::overlap(newKeyPoint, kpt) > maxOverlap) {
+								bOverlap = true;
+								if (newKeyPoint.response > kpt.response && (replaceIdx < 0 || *it < replaceIdx)) {
+									replaceIdx = *it;
+								}
+							}
+						}
+					}
+				}
+
+				int newCell = cy * gridCols + cx;
+				if (replaceIdx >= 0) {
+					// move the replaced keypoint's index from its old cell to the new one
+					const cv::Point2f &oldPt = keypoints[replaceIdx].pt;
+					std::vector<int> &oldCell = grid[((int)oldPt.y / cellSize) * gridCols + (int)oldPt.x / cellSize];
+					oldCell.erase(std::find(oldCell.begin(), oldCell.end(), replaceIdx));
+					grid[newCell].push_back(replaceIdx);
+					keypoints[replaceIdx] = newKeyPoint;
+				}
+				else if (!bOverlap) {
+					grid[newCell].push_back((int)keypoints.size());
+					keypoints.push_back(newKeyPoint);
+				}
+			}
+		}
+	}
+}
+
+void detKeypointsHarris(std::vector<cv::KeyPoint> &keypoints, const cv::Mat &img, bool bVis, bool bGridNMS, int minResponse)
+{
+	int blockSize = 2; // size of neighbourhood considered for corner detection
+	int apertureSize = 3;// Aperture parameter for the Sobel() operator
+	double k = 0.04; // Harris detector free parameter
+	int borderType = cv::BORDER_DEFAULT; // Pixel extrapolation methods
+	// minResponse: minimum value for a corner in the 8bit scaled response matrix
+
+	ScopedTimer timer("detKeypointsHarris");
+	cv::Mat dst, dst_norm, dst_norm_scaled;
+	dst = cv::Mat::zeros(img.size(), CV_32FC1);
+	cv::cornerHarris(img, dst, blockSize, apertureSize, k, borderType);
+	cv::normalize(dst, dst_norm, 0, 255, cv::NORM_MINMAX, CV_32FC1, cv::Mat());
+	cv::convertScaleAbs(dst_norm, dst_norm_scaled);
+	
+	// Locate local maxima in the Harris response matrix 
+	// and perform a non-maximum suppression (NMS) in a local neighborhood around 
+	// each maximum. The resulting coordinates shall be stored in a list of keypoints 
+	// of the type `vector<cv::KeyPoint>`.
+
+	double maxOverlap = 0.0; // max permissible overlap between two features in %, used during non-maxima suppression
+
+	if (bGridNMS) {
+		nmsHarrisGrid(dst_norm, 1.0, 0.0, minResponse, apertureSize, maxOverlap, keypoints);
+	}
+	else {
+		nmsHarrisBruteForce(dst_norm, 1.0, 0.0, minResponse, apertureSize, maxOverlap, keypoints);
+	}
+	addCounter("keypoints_detected", keypoints.size());
+	if (stageLoggingEnabled()) {
+		cout << "Harris detection (" << (bGridNMS ? "grid" : "brute-force") << " NMS) with n=" << keypoints.size() << " keypoints in " << timer.elapsedMs() << " ms\n";
+	}
 
 	// visualize keypoints
 	if (bVis)
@@ -198,12 +511,142 @@ void detKeypointsHarris(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool
 }
 
 
-void detKeypointsModern(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, std::string detectorType, bool bVis = false)
+
+// Reusable buffers of the fused Harris kernel, one set per thread
+struct HarrisWorkspace {
+	cv::Mat response;                      // raw Harris response, CV_32F
+	std::vector<float> prod[2];            // dx*dx, dx*dy, dy*dy of two image rows, interleaved
+	int prodRow[2];                        // image row held by prod[i], -1 if none
+};
+
+static inline int reflect101(int i, int n)
+{
+	if (n == 1) {
+		return 0;
+	}
+	return i < 0 ? -i : (i >= n ? 2 * n - 2 - i : i);
+}
+
+// Sobel (aperture 3) derivative products of one image row, BORDER_REFLECT_101 like cv::cornerHarris
+static void harrisProducts(const cv::Mat &img, int y, float scale, float *prod)
+{
+	int cols = img.cols;
+	const uchar *r0 = img.ptr<uchar>(reflect101(y - 1, img.rows));
+	const uchar *r1 = img.ptr<uchar>(y);
+	const uchar *r2 = img.ptr<uchar>(reflect101(y + 1, img.rows));
+
+	auto product = [&](int x, int xl, int xr) {
+		float dx = ((r0[xr] - r0[xl]) + 2 * (r1[xr] - r1[xl]) + (r2[xr] - r2[xl])) * scale;
+		float dy = ((r2[xl] + 2 * r2[x] + r2[xr]) - (r0[xl] + 2 * r0[x] + r0[xr])) * scale;
+		prod[3 * x] = dx * dx;
+		prod[3 * x + 1] = dx * dy;
+		prod[3 * x + 2] = dy * dy;
+	};
+	product(0, reflect101(-1, cols), reflect101(1, cols));
+	for (int x = 1; x < cols - 1; ++x) {
+		product(x, x - 1, x + 1);
+	}
+	if (cols > 1) {
+		product(cols - 1, cols - 2, reflect101(cols, cols));
+	}
+}
+
+// Derivative products of image row y, computed at most once while streaming over the rows
+static const float *harrisProductRow(const cv::Mat &img, int y, int keepRow, float scale, HarrisWorkspace &ws)
+{
+	for (int i = 0; i < 2; ++i) {
+		if (ws.prodRow[i] == y) {
+			return ws.prod[i].data();
+		}
+	}
+	int slot = ws.prodRow[0] == keepRow ? 1 : 0; // do not overwrite the other row of the current 2x2 block
+	harrisProducts(img, y, scale, ws.prod[slot].data());
+	ws.prodRow[slot] = y;
+	return ws.prod[slot].data();
+}
+
+// Fused Harris detector: structure tensor, 2x2 box sum and response are computed in one streaming pass over the
+// image rows (two rows of derivative products in flight), while tracking the response range. Threshold and NMS then
+// run in a second pass directly on the raw response, which the min/max normalization of the 8bit scaled response
+// requires. All buffers are reused between calls, the 8bit visualization image is only created if bVis is set.
+// Same parameters as detKeypointsHarris, results agree up to float rounding at the threshold.
+void detKeypointsHarrisFused(std::vector<cv::KeyPoint> &keypoints, const cv::Mat &img, bool bVis, bool bGridNMS, int minResponse)
+{
+	const int apertureSize = 3; // Sobel aperture, fixed to 3 by the kernel
+	const int blockSize = 2;    // size of neighbourhood considered for corner detection, fixed to 2 by the kernel
+	const float k = 0.04f;      // Harris detector free parameter
+	// minResponse: minimum value for a corner in the 8bit scaled response matrix
+	double maxOverlap = 0.0;    // max permissible overlap between two features in %, used during non-maxima suppression
+
+	ScopedTimer timer("detKeypointsHarrisFused");
+	CV_Assert(img.type() == CV_8UC1);
+
+	thread_local HarrisWorkspace ws;
+	int rows = img.rows, cols = img.cols;
+	ws.response.create(rows, cols, CV_32F);
+	for (int i = 0; i < 2; ++i) {
+		ws.prod[i].resize(3 * cols);
+		ws.prodRow[i] = -1;
+	}
+
+	// same derivative scaling as cv::cornerHarris for 8bit images
+	float scale = (float)(1.0 / ((1 << (apertureSize - 1)) * blockSize * 255.0));
+
+	float minR = std::numeric_limits<float>::max(), maxR = -std::numeric_limits<float>::max();
+	for (int y = 0; y < rows; ++y) {
+		// 2x2 box with anchor (1,1) covers rows y-1, y and columns x-1, x
+		int yPrev = reflect101(y - 1, rows);
+		const float *p0 = harrisProductRow(img, yPrev, y, scale, ws);
+		const float *p1 = harrisProductRow(img, y, yPrev, scale, ws);
+		float *r = ws.response.ptr<float>(y);
+
+		for (int x = 0; x < cols; ++x) {
+			int xPrev = 3 * reflect101(x - 1, cols), xCur = 3 * x;
+			float a = p0[xPrev] + p0[xCur] + p1[xPrev] + p1[xCur];
+			float b = p0[xPrev + 1] + p0[xCur + 1] + p1[xPrev + 1] + p1[xCur + 1];
+			float c = p0[xPrev + 2] + p0[xCur + 2] + p1[xPrev + 2] + p1[xCur + 2];
+			float resp = a * c - b * b - k * (a + c) * (a + c);
+			r[x] = resp;
+			minR = min(minR, resp);
+			maxR = max(maxR, resp);
+		}
+	}
+
+	// min/max normalization to [0, 255] as done by cv::normalize(NORM_MINMAX)
+	double normScale = maxR > minR ? 255.0 / ((double)maxR - minR) : 0.0;
+	double normShift = -minR * normScale;
+
+	if (bGridNMS) {
+		nmsHarrisGrid(ws.response, normScale, normShift, minResponse, apertureSize, maxOverlap, keypoints);
+	}
+	else {
+		nmsHarrisBruteForce(ws.response, normScale, normShift, minResponse, apertureSize, maxOverlap, keypoints);
+	}
+	addCounter("keypoints_detected", keypoints.size());
+	if (stageLoggingEnabled()) {
+		cout << "Fused Harris detection with n=" << keypoints.size() << " keypoints in " << timer.elapsedMs() << " ms\n";
+	}
+
+	// visualize keypoints
+	if (bVis)
+	{
+		cv::Mat dst_norm_scaled;
+		cv::convertScaleAbs(ws.response, dst_norm_scaled, normScale, normShift);
+		string windowName = "Harris Corner Detector Results";
+		cv::namedWindow(windowName, 6);
+		cv::Mat visImage = dst_norm_scaled.clone();
+		cv::drawKeypoints(dst_norm_scaled, keypoints, visImage, cv::Scalar::all(-1), cv::DrawMatchesFlags::DRAW_RICH_KEYPOINTS);
+		cv::imshow(windowName, visImage);
+	}
+}
+
+// Create one of the modern keypoint detectors, returns an empty pointer for SHITOMASI and HARRIS
+// thresholdFAST: difference between intensity of the central pixel and pixels of a circle around this pixel
+cv::Ptr<cv::FeatureDetector> createDetector(std::string detectorType, int thresholdFAST)
 {
 	cv::Ptr<cv::FeatureDetector> detector;
 
 	if ("FAST" == detectorType){
-		int thresholdFAST = 80; // difference between intensity of the central pixel and pixels of a circle around this pixel
 		bool nonMaxSuppression = true; // perform non-maxima suppression on keypoints
 		cv::FastFeatureDetector::DetectorType type = cv::FastFeatureDetector::TYPE_9_16; // TYPE_9_16, TYPE_7_12, TYPE_5_8
 		detector = cv::FastFeatureDetector::create(thresholdFAST, nonMaxSuppression, type);
@@ -226,11 +669,17 @@ void detKeypointsModern(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, std:
 	else {
 		// Do nothing
 	}
+	return detector;
+}
 
-	double t = (double)cv::getTickCount();
+static void detKeypointsModern(cv::Ptr<cv::FeatureDetector> &detector, std::vector<cv::KeyPoint> &keypoints, const cv::Mat &img, std::string detectorType, bool bVis)
+{
+	ScopedTimer timer("detKeypointsModern");
 	detector->detect(img, keypoints);
-	t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
-	cout << detectorType + " with n = " << keypoints.size() << " keypoints in " << 1000 * t / 1.0 << " ms" << endl;
+	addCounter("keypoints_detected", keypoints.size());
+	if (stageLoggingEnabled()) {
+		cout << detectorType + " with n = " << keypoints.size() << " keypoints in " << timer.elapsedMs() << " ms\n";
+	}
 
 	if (bVis) {
 		// visualize results
@@ -240,4 +689,419 @@ void detKeypointsModern(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, std:
 		cv::namedWindow(windowName, 6);
 		imshow(windowName, visImage);
 	}
-}
\ No newline at end of file
+}
+
+void detKeypointsModern(std::vector<cv::KeyPoint> &keypoints, const cv::Mat &img, std::string detectorType, bool bVis = false)
+{
+	cv::Ptr<cv::FeatureDetector> detector = createDetector(detectorType);
+	detKeypointsModern(detector, keypoints, img, detectorType, bVis);
+}
+
+// Same as above, but reuses the detector held by the pipeline context
+void detKeypointsModern(std::vector<cv::KeyPoint> &keypoints, const cv::Mat &img, PipelineContext &ctx, bool bVis)
+{
+	detKeypointsModern(ctx.detector, keypoints, img, ctx.detectorType, bVis);
+}
+
+// Run the detector configured in the pipeline context on the whole image
+void detKeypoints(std::vector<cv::KeyPoint> &keypoints, const cv::Mat &img, PipelineContext &ctx, bool bVis)
+{
+	switch (ctx.detectorKind)
+	{
+	case DetectorKind::SHITOMASI:
+		detKeypointsShiTomasi(keypoints, img, bVis, ctx.qualityLevelShiTomasi);
+		break;
+	case DetectorKind::HARRIS:
+		if (ctx.bFusedHarris) {
+			detKeypointsHarrisFused(keypoints, img, bVis, ctx.bGridNMS, ctx.minResponseHarris);
+		}
+		else {
+			detKeypointsHarris(keypoints, img, bVis, ctx.bGridNMS, ctx.minResponseHarris);
+		}
+		break;
+	default: // FAST, BRISK, ORB, AKAZE, FREAK, SIFT
+		if (ctx.detector) {
+			detKeypointsModern(keypoints, img, ctx, bVis);
+		}
+		break;
+	}
+}
+
+// No. of pixels a detector needs around a keypoint for its response to be the same as on the full image
+int detectorBorder(DetectorKind detectorKind)
+{
+	switch (detectorKind)
+	{
+	case DetectorKind::FAST:
+		return 3; // radius of the Bresenham circle
+	case DetectorKind::HARRIS:
+	case DetectorKind::SHITOMASI:
+		return 4; // Sobel aperture plus block size
+	case DetectorKind::ORB:
+		return 31; // default edgeThreshold / patchSize
+	default:
+		return 32; // scale-space detectors (BRISK, AKAZE, SIFT) at the finer octaves
+	}
+}
+
+int detectorBorder(std::string detectorType)
+{
+	return detectorBorder(parseDetectorKind(detectorType));
+}
+
+// Run the detector only on img(roi), padded by the detector's border requirement, and translate the keypoints
+// back into full-frame coordinates. Detection cost scales with the ROI area instead of the frame size.
+// Note that detectors which normalize their response (HARRIS, SHITOMASI) do so relative to the ROI.
+void detKeypointsRoi(std::vector<cv::KeyPoint> &keypoints, const cv::Mat &img, cv::Rect roi, PipelineContext &ctx, bool bVis)
+{
+	int border = detectorBorder(ctx.detectorKind);
+	cv::Rect padded(roi.x - border, roi.y - border, roi.width + 2 * border, roi.height + 2 * border);
+	padded = padded & cv::Rect(0, 0, img.cols, img.rows);
+
+	cv::Mat imgRoi = img(padded); // view into the frame, no copy
+	detKeypoints(keypoints, imgRoi, ctx, bVis);
+
+	cv::Point2f offset((float)padded.x, (float)padded.y);
+	for (auto it = keypoints.begin(); it != keypoints.end(); ++it) {
+		it->pt += offset;
+	}
+}
+
+// Detector and descriptor are the same scale-space algorithm, so one detectAndCompute call can do both.
+// BRISK, ORB and AKAZE all rebuild their pyramid or nonlinear scale space in compute(), which this avoids.
+bool supportsDetectAndCompute(const PipelineContext &ctx)
+{
+	DetectorKind det = ctx.detectorKind;
+	return (det == DetectorKind::BRISK || det == DetectorKind::ORB || det == DetectorKind::AKAZE) &&
+	       ctx.detectorType.compare(ctx.descriptorType) == 0;
+}
+
+// Detect keypoints and compute their descriptors with ctx.detector in a single pass over the scale space,
+// on the padded roi only (an empty roi means the whole image); keypoints come back in full-frame coordinates.
+// The detectors are created with the same parameters as the extractors, so the descriptors are the same kind.
+void detDescKeypoints(std::vector<cv::KeyPoint> &keypoints, cv::Mat &descriptors, const cv::Mat &img, cv::Rect roi, PipelineContext &ctx)
+{
+	ScopedTimer timer("detDescKeypoints");
+
+	cv::Rect padded(0, 0, img.cols, img.rows);
+	if (roi.area() > 0) {
+		int border = detectorBorder(ctx.detectorKind);
+		padded = cv::Rect(roi.x - border, roi.y - border, roi.width + 2 * border, roi.height + 2 * border) & padded;
+	}
+
+	cv::Mat imgRoi = img(padded); // view into the frame, no copy
+	ctx.detector->detectAndCompute(imgRoi, cv::noArray(), keypoints, descriptors);
+
+	cv::Point2f offset((float)padded.x, (float)padded.y);
+	for (auto it = keypoints.begin(); it != keypoints.end(); ++it) {
+		it->pt += offset;
+	}
+	addCounter("keypoints_detected", keypoints.size());
+	if (stageLoggingEnabled()) {
+		cout << ctx.detectorType << " detection and description with n=" << keypoints.size() << " keypoints in " << timer.elapsedMs() << " ms\n";
+	}
+}
+
+// Transparent API (cv::UMat) variants for the OPENCL backend: images and descriptors stay on the device and
+// OpenCV runs the OpenCL kernels it has for a detector, extractor or matcher (ORB, FAST, BFMatcher), falling back
+// to the CPU implementation otherwise. Only keypoints and matches come back to the host.
+
+// The BF matcher has OpenCL kernels, FLANN, MAT_HAMMING, the gated matcher and the cross-check need host descriptors
+bool supportsDeviceMatching(const PipelineContext &ctx)
+{
+	return ctx.matcherKind == MatcherKind::BF && !ctx.bGatedMatching && !ctx.bCrossCheck;
+}
+
+// Modern detector on the padded roi of a device image (an empty roi means the whole image), full-frame coordinates
+void detKeypointsDevice(std::vector<cv::KeyPoint> &keypoints, const cv::UMat &img, cv::Rect roi, PipelineContext &ctx)
+{
+	ScopedTimer timer("detKeypointsDevice");
+
+	cv::Rect padded(0, 0, img.cols, img.rows);
+	if (roi.area() > 0) {
+		int border = detectorBorder(ctx.detectorKind);
+		padded = cv::Rect(roi.x - border, roi.y - border, roi.width + 2 * border, roi.height + 2 * border) & padded;
+	}
+
+	ctx.detector->detect(img(padded), keypoints); // device view, no copy
+
+	cv::Point2f offset((float)padded.x, (float)padded.y);
+	for (auto it = keypoints.begin(); it != keypoints.end(); ++it) {
+		it->pt += offset;
+	}
+	addCounter("keypoints_detected", keypoints.size());
+	if (stageLoggingEnabled()) {
+		cout << ctx.detectorType << " detection on the OpenCL device with n=" << keypoints.size() << " keypoints in " << timer.elapsedMs() << " ms\n";
+	}
+}
+
+void descKeypoints(vector<cv::KeyPoint> &keypoints, const cv::UMat &img, cv::UMat &descriptors, PipelineContext &ctx)
+{
+	ScopedTimer timer("descKeypointsDevice");
+	ctx.extractor->compute(img, keypoints, descriptors);
+	if (stageLoggingEnabled()) {
+		cout << ctx.descriptorType << " descriptor extraction on the OpenCL device in " << timer.elapsedMs() << " ms\n";
+	}
+}
+
+void matchDescriptors(const cv::UMat &descSource, const cv::UMat &descRef, std::vector<cv::DMatch> &matches, PipelineContext &ctx)
+{
+	ScopedTimer timer("matchDescriptorsDevice");
+	switch (ctx.selectorKind)
+	{
+	case SelectorKind::NN:
+		ctx.matcher->match(descSource, descRef, matches);
+		break;
+	case SelectorKind::KNN:
+		// only the k-NN lists are downloaded, the ratio test runs on the host
+		ctx.knnMatches.clear();
+		ctx.matcher->knnMatch(descSource, descRef, ctx.knnMatches, 2);
+		filterRatioTest(ctx.knnMatches, ctx.ratio, matches);
+		break;
+	default:
+		break;
+	}
+	addCounter("matches", matches.size());
+}
+
+// Detectors which may be run tile by tile
+bool supportsTiledDetection(DetectorKind detectorKind)
+{
+	return detectorKind == DetectorKind::SHITOMASI || detectorKind == DetectorKind::HARRIS || detectorKind == DetectorKind::FAST;
+}
+
+bool supportsTiledDetection(std::string detectorType)
+{
+	return supportsTiledDetection(parseDetectorKind(detectorType));
+}
+
+// Merge per-tile keypoints. Keypoints of the same tile have already been suppressed by the detector,
+// so only overlapping keypoints of different tiles (next to a seam) compete, strongest response first.
+static void mergeTiles(const std::vector<std::vector<cv::KeyPoint>> &tileKeypoints, std::vector<cv::KeyPoint> &keypoints)
+{
+	// storage is reused from frame to frame
+	thread_local std::vector<cv::KeyPoint> all;
+	thread_local std::vector<int> tileOf, order;
+	thread_local std::vector<std::vector<int>> grid;
+	thread_local std::vector<char> bKeep;
+	all.clear();
+	tileOf.clear();
+	float maxSize = 1.0f, maxX = 0.0f, maxY = 0.0f;
+	for (std::size_t t = 0; t < tileKeypoints.size(); ++t) {
+		for (auto it = tileKeypoints[t].begin(); it != tileKeypoints[t].end(); ++it) {
+			all.push_back(*it);
+			tileOf.push_back((int)t);
+			maxSize = max(maxSize, it->size);
+			maxX = max(maxX, it->pt.x);
+			maxY = max(maxY, it->pt.y);
+		}
+	}
+
+	// ties keep their tile order, like a stable sort but without its temporary buffer
+	order.resize(all.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::sort(order.begin(), order.end(), [](int a, int b) {
+		return all[a].response > all[b].response || (all[a].response == all[b].response && a < b);
+	});
+
+	// keypoints overlap only if their centres are closer than maxSize, so neighbouring cells suffice
+	int gridCols = (int)(maxX / maxSize) + 1, gridRows = (int)(maxY / maxSize) + 1;
+	if ((int)grid.size() < gridCols * gridRows) {
+		grid.resize(gridCols * gridRows); // accepted indices into all, only the first gridCols * gridRows cells are used
+	}
+	for (int i = 0; i < gridCols * gridRows; ++i) {
+		grid[i].clear();
+	}
+
+	bKeep.assign(all.size(), 0);
+	for (auto idx = order.begin(); idx != order.end(); ++idx) {
+		const cv::KeyPoint &kpt = all[*idx];
+		int cx = (int)(kpt.pt.x / maxSize), cy = (int)(kpt.pt.y / maxSize);
+		bool bSuppressed = false;
+		for (int gy = max(0, cy - 1); gy <= min(gridRows - 1, cy + 1) && !bSuppressed; ++gy) {
+			for (int gx = max(0, cx - 1); gx <= min(gridCols - 1, cx + 1) && !bSuppressed; ++gx) {
+				const std::vector<int> &cell = grid[gy * gridCols + gx];
+				for (auto it = cell.begin(); it != cell.end(); ++it) {
+					if (tileOf[*it] != tileOf[*idx] && cv::KeyPoint::overlap(kpt, all[*it]) > 0.0f) {
+						bSuppressed = true;
+						break;
+					}
+				}
+			}
+		}
+		if (!bSuppressed) {
+			grid[cy * gridCols + cx].push_back(*idx);
+			bKeep[*idx] = 1;
+		}
+	}
+
+	// emit in tile order so that detector ordering (e.g. Shi-Tomasi quality order) is kept within each tile
+	for (std::size_t i = 0; i < all.size(); ++i) {
+		if (bKeep[i]) {
+			keypoints.push_back(all[i]);
+		}
+	}
+}
+
+// Detector call of one tile worker. HARRIS and SHITOMASI only keep state in thread_local buffers; FAST gets a
+// detector per worker thread instead of sharing ctx.detector, as cv::Feature2D::detect is not documented to be
+// safe for concurrent calls on one object. The worker's detector is rebuilt when the threshold changes.
+static void detectTile(std::vector<cv::KeyPoint> &keypoints, const cv::Mat &img, const PipelineContext &ctx)
+{
+	switch (ctx.detectorKind)
+	{
+	case DetectorKind::SHITOMASI:
+		detKeypointsShiTomasi(keypoints, img, false, ctx.qualityLevelShiTomasi);
+		break;
+	case DetectorKind::HARRIS:
+		if (ctx.bFusedHarris) {
+			detKeypointsHarrisFused(keypoints, img, false, ctx.bGridNMS, ctx.minResponseHarris);
+		}
+		else {
+			detKeypointsHarris(keypoints, img, false, ctx.bGridNMS, ctx.minResponseHarris);
+		}
+		break;
+	default:
+	{
+		thread_local cv::Ptr<cv::FeatureDetector> detector;
+		thread_local std::string detectorType;
+		thread_local int thresholdFAST = -1;
+		if (!detector || detectorType.compare(ctx.detectorType) != 0 || thresholdFAST != ctx.thresholdFAST) {
+			detector = createDetector(ctx.detectorType, ctx.thresholdFAST);
+			detectorType = ctx.detectorType;
+			thresholdFAST = ctx.thresholdFAST;
+		}
+		if (detector) {
+			detKeypointsModern(detector, keypoints, img, ctx.detectorType, false);
+		}
+		break;
+	}
+	}
+}
+
+// Split `area` into tileGrid.width x tileGrid.height tiles and run the detector on every tile in parallel.
+// Each tile is padded by the detector's border requirement and only keeps keypoints inside its own part of the area.
+// maxKeypoints (<= 0 -> no limit) is spread evenly over the tiles, so the merged keypoints never exceed it.
+// Detectors which normalize their response (HARRIS, SHITOMASI) do so per tile.
+// Returns the no. of keypoints of all tiles before the limit, which is also recorded once as keypoints_detected.
+std::size_t detKeypointsTiled(std::vector<cv::KeyPoint> &keypoints, const cv::Mat &img, cv::Rect area, PipelineContext &ctx,
+                       cv::Size tileGrid, int maxKeypoints)
+{
+	ScopedTimer timer("detKeypointsTiled");
+	area = area & cv::Rect(0, 0, img.cols, img.rows);
+	int tileCols = max(1, tileGrid.width), tileRows = max(1, tileGrid.height);
+	int nTiles = tileCols * tileRows;
+	int border = detectorBorder(ctx.detectorKind);
+	bool bByResponse = ctx.detectorKind != DetectorKind::SHITOMASI; // Shi-Tomasi keypoints carry no response, but come sorted by quality
+
+	// the tile lists of the calling thread are reused from frame to frame, the workers fill them through these references
+	thread_local std::vector<std::vector<cv::KeyPoint>> tileStorage;
+	thread_local std::vector<std::size_t> tileDetectedStorage;
+	std::vector<std::vector<cv::KeyPoint>> &tileKeypoints = tileStorage;
+	std::vector<std::size_t> &tileDetected = tileDetectedStorage;
+	tileKeypoints.resize(nTiles);
+	tileDetected.assign(nTiles, 0);
+	for (auto it = tileKeypoints.begin(); it != tileKeypoints.end(); ++it) {
+		it->clear();
+	}
+	cv::parallel_for_(cv::Range(0, nTiles), [&](const cv::Range &range) {
+		ScopedCounterMute mute; // the detectors would count once per tile
+		for (int t = range.start; t < range.end; ++t) {
+			int tx = t % tileCols, ty = t / tileCols;
+			int x0 = area.x + area.width * tx / tileCols, x1 = area.x + area.width * (tx + 1) / tileCols;
+			int y0 = area.y + area.height * ty / tileRows, y1 = area.y + area.height * (ty + 1) / tileRows;
+			cv::Rect core(x0, y0, x1 - x0, y1 - y0);
+			cv::Rect padded = cv::Rect(x0 - border, y0 - border, core.width + 2 * border, core.height + 2 * border) & cv::Rect(0, 0, img.cols, img.rows);
+
+			cv::Mat imgTile = img(padded);
+			thread_local std::vector<cv::KeyPoint> kpts; // per worker thread
+			kpts.clear();
+			detectTile(kpts, imgTile, ctx);
+
+			// back to full-frame coordinates, drop keypoints which belong to a neighbouring tile
+			std::vector<cv::KeyPoint> &out = tileKeypoints[t];
+			cv::Point2f offset((float)padded.x, (float)padded.y);
+			for (auto it = kpts.begin(); it != kpts.end(); ++it) {
+				it->pt += offset;
+				if (core.contains(it->pt)) {
+					out.push_back(*it);
+				}
+			}
+			tileDetected[t] = out.size();
+
+			// the first maxKeypoints % nTiles tiles take one keypoint more, the quotas add up to maxKeypoints
+			if (maxKeypoints > 0) {
+				int quota = maxKeypoints / nTiles + (t < maxKeypoints % nTiles ? 1 : 0);
+				if (quota == 0) {
+					out.clear();
+				}
+				else {
+					limitKeypoints(out, quota, bByResponse, false);
+				}
+			}
+		}
+	});
+
+	keypoints.clear();
+	mergeTiles(tileKeypoints, keypoints); // only drops keypoints, the limit still holds
+
+	std::size_t detected = 0;
+	for (auto it = tileDetected.begin(); it != tileDetected.end(); ++it) {
+		detected += *it;
+	}
+	addCounter("keypoints_detected", detected);
+	return detected;
+}
+
+// Adaptive non-maximal suppression: every keypoint gets the distance to the closest clearly stronger keypoint
+// (response below 0.9 of it) as suppression radius, the maxKeypoints largest radii are kept.
+// Quadratic in the no. of candidates, so meant for ROI-sized keypoint sets.
+static void anmsKeypoints(std::vector<cv::KeyPoint> &keypoints, int maxKeypoints)
+{
+	const float robustness = 0.9f;
+	std::sort(keypoints.begin(), keypoints.end(), [](const cv::KeyPoint &a, const cv::KeyPoint &b) { return a.response > b.response; });
+
+	std::vector<float> radiusSq(keypoints.size(), std::numeric_limits<float>::max());
+	for (std::size_t i = 1; i < keypoints.size(); ++i) {
+		for (std::size_t j = 0; j < i && keypoints[j].response * robustness > keypoints[i].response; ++j) {
+			cv::Point2f d = keypoints[i].pt - keypoints[j].pt;
+			radiusSq[i] = min(radiusSq[i], d.x * d.x + d.y * d.y);
+		}
+	}
+
+	std::vector<int> order(keypoints.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::nth_element(order.begin(), order.begin() + maxKeypoints, order.end(),
+	                 [&radiusSq](int a, int b) { return radiusSq[a] > radiusSq[b]; });
+	order.resize(maxKeypoints);
+	std::sort(order.begin(), order.end()); // keep descending response order
+
+	std::vector<cv::KeyPoint> selected;
+	selected.reserve(maxKeypoints);
+	for (auto it = order.begin(); it != order.end(); ++it) {
+		selected.push_back(keypoints[*it]);
+	}
+	keypoints.swap(selected);
+}
+
+// Keep at most maxKeypoints keypoints. With bByResponse the strongest ones are picked by partial selection (O(n)),
+// otherwise the first ones are kept (for detectors which return keypoints sorted by quality, e.g. Shi-Tomasi).
+// bAnms spreads the selection over the image with adaptive non-maximal suppression instead.
+void limitKeypoints(std::vector<cv::KeyPoint> &keypoints, int maxKeypoints, bool bByResponse, bool bAnms)
+{
+	if (maxKeypoints < 0 || (int)keypoints.size() <= maxKeypoints) {
+		return;
+	}
+
+	if (!bByResponse) {
+		keypoints.resize(maxKeypoints);
+	}
+	else if (bAnms) {
+		anmsKeypoints(keypoints, maxKeypoints);
+	}
+	else {
+		std::nth_element(keypoints.begin(), keypoints.begin() + maxKeypoints, keypoints.end(),
+		                 [](const cv::KeyPoint &a, const cv::KeyPoint &b) { return a.response > b.response; });
+		keypoints.resize(maxKeypoints);
+	}
+}
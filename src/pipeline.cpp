@@ -0,0 +1,764 @@
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include <opencv2/core/ocl.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "pipeline.hpp"
+#include "boundedQueue.h"
+#include "instrumentation.hpp"
+#include "kltTracker.hpp"
+#include "keypointSoA.hpp"
+#include "featureCache.hpp"
+#include "batchMatcher.hpp"
+#include "matPool.hpp"
+#include "descriptorIndex.hpp"
+
+using namespace std;
+
+// Build the detector, extractor and matcher for the configured pipeline
+void initPipelineContext(PipelineContext &ctx, const PipelineConfig &cfg)
+{
+    ctx.thresholdFAST = cfg.thresholdFAST;
+    ctx.ratio = cfg.minDescDistRatio;
+    ctx.minResponseHarris = cfg.harrisMinResponse;
+    ctx.qualityLevelShiTomasi = cfg.shiTomasiQualityLevel;
+    ctx.budget = KeypointBudget();
+    ctx.budget.bEnabled = cfg.bAdaptiveBudget;
+    ctx.budget.deadlineMs = cfg.frameDeadlineMs;
+    ctx.budget.minKeypoints = cfg.minKeypointBudget;
+    ctx.budget.maxKeypoints = cfg.maxKeypointBudget;
+    ctx.maxKeypoints = cfg.bAdaptiveBudget ? min(max(cfg.maxKeypoints, cfg.minKeypointBudget), cfg.maxKeypointBudget)
+                                           : cfg.maxKeypoints;
+    initPipelineContext(ctx, cfg.detectorType, cfg.descriptorType, cfg.matcherType, cfg.descriptorClass, cfg.selectorType);
+    ctx.bGatedMatching = cfg.bGatedMatching;
+    ctx.gateRadius = cfg.gateRadius;
+    ctx.bPredictMotion = cfg.bPredictMotion;
+    ctx.bGridNMS = cfg.bGridNMS;
+    ctx.bFusedHarris = cfg.bFusedHarris;
+    ctx.bCrossCheck = cfg.bCrossCheck;
+    ctx.predictedMotion = cv::Point2f(0.0f, 0.0f);
+    ctx.framesSinceDetection = 0;
+
+    ctx.bUseOpenCL = false;
+    if (cfg.backend.compare("OPENCL") == 0)
+    {
+        cv::ocl::setUseOpenCL(true);
+        ctx.bUseOpenCL = cv::ocl::useOpenCL();
+        if (!ctx.bUseOpenCL)
+        {
+            cerr << "NOTE: no OpenCL device available, using the CPU backend" << endl;
+        }
+    }
+    else if (cfg.backend.compare("CPU") != 0)
+    {
+        throw invalid_argument("unknown backend " + cfg.backend);
+    }
+    // descriptors only stay on the device if nothing downstream reads them on the host
+    ctx.bHostDescriptors = !ctx.bUseOpenCL || !supportsDeviceMatching(ctx) || cfg.matchHistory > 1 ||
+                           cfg.bKltTracking || !cfg.featureCacheDir.empty();
+    ctx.transferMs = 0.0;
+}
+
+// Assemble the filename of the image with the given sequence index
+string imageFilename(const PipelineConfig &cfg, size_t imgIndex)
+{
+    ostringstream imgNumber;
+    imgNumber << setfill('0') << setw(cfg.imgFillWidth) << cfg.imgStartIndex + imgIndex;
+    return cfg.imgBasePath + cfg.imgPrefix + imgNumber.str() + cfg.imgFileType;
+}
+
+// Open the configured frame source: numbered image files (optionally prefetched), a video or camera, or a raw dump
+unique_ptr<FrameSource> createFrameSource(const PipelineConfig &cfg)
+{
+    if (cfg.sourceType.compare("VIDEO") == 0)
+    {
+        return unique_ptr<FrameSource>(new VideoCaptureSource(cfg.sourceUri));
+    }
+    else if (cfg.sourceType.compare("RAW") == 0)
+    {
+        return unique_ptr<FrameSource>(new RawGrayscaleSource(cfg.sourceUri, cfg.rawFrameSize));
+    }
+    else if (cfg.sourceType.compare("IMAGES") != 0)
+    {
+        throw invalid_argument("unknown frame source type " + cfg.sourceType);
+    }
+
+    size_t numImages = cfg.imgEndIndex >= cfg.imgStartIndex ? cfg.imgEndIndex - cfg.imgStartIndex + 1 : 0;
+    if (cfg.prefetchSize > 0 && numImages > 0)
+    {
+        // decode the upcoming images on background threads
+        vector<string> filenames;
+        for (size_t imgIndex = 0; imgIndex < numImages; imgIndex++)
+        {
+            filenames.push_back(imageFilename(cfg, imgIndex));
+        }
+        return unique_ptr<FrameSource>(new ImagePrefetcher(filenames, cfg.prefetchSize, cfg.prefetchThreads));
+    }
+    return unique_ptr<FrameSource>(new ImageSequenceSource([cfg](size_t imgIndex) { return imageFilename(cfg, imgIndex); }, numImages));
+}
+
+// Read the next frame of the source directly into the frame's image storage, false at the end of the stream
+bool loadFrame(FrameSource &source, size_t frameIndex, DataFrame &frame)
+{
+    ScopedTimer timer("stage.load");
+    if (!source.read(frame.cameraImg))
+    {
+        return false;
+    }
+
+    frame.frameIndex = frameIndex;
+    frame.keypoints.clear();
+    frame.kptMatches.clear();
+    frame.historyMatches.clear();
+    frame.bPyramidValid = false;
+    frame.descIndex.reset(); // the slot's index belonged to the evicted frame
+    releaseCachedFeatures(frame);
+    return true;
+}
+
+// Only keep keypoints on the preceding vehicle and limit their number to ctx.maxKeypoints (unless bAlreadyLimited).
+// Both filters run on a structure-of-arrays copy, where they are branch-free loops over contiguous floats.
+// The no. of keypoints the limit chose from is left in ctx.budget.candidates for the keypoint budget controller,
+// if bAlreadyLimited the caller has set it to the no. of keypoints before its own limit.
+static void selectKeypoints(const PipelineConfig &cfg, PipelineContext &ctx, vector<cv::KeyPoint> &keypoints, bool bAlreadyLimited)
+{
+    thread_local KeypointSoA soa; // storage is reused from frame to frame
+    thread_local vector<uchar> mask;
+    soa.assign(keypoints);
+
+    //// STUDENT ASSIGNMENT
+    //// TASK MP.3 -> only keep keypoints on the preceding vehicle
+
+    // only keep keypoints on the preceding vehicle, compacted in a single pass
+    if (cfg.bFocusOnVehicle)
+    {
+		soa.roiMask(cfg.vehicleRect, mask);
+		soa.compact(mask);
+
+		addCounter("keypoints_in_roi", soa.count());
+		if (stageLoggingEnabled()) {
+			std::cout << "NOTE: Number of keypoints only on the car is " << soa.count() << '\n';
+		}
+    }
+
+    //// EOF STUDENT ASSIGNMENT
+
+    // optional : limit number of keypoints (helpful for debugging and learning), done before description
+    // so that no descriptors are computed for discarded keypoints (tiled detection has already limited the frame)
+    // (the adaptive budget always limits, it has no other way to cut the per-keypoint cost)
+    bool bLimit = (cfg.bLimitKpts || ctx.budget.bEnabled) && !bAlreadyLimited;
+    if (!bAlreadyLimited)
+    {
+        ctx.budget.candidates = soa.count();
+    }
+    // there is no response info for SHITOMASI, so keep the first ones as they are sorted in descending quality order
+    bool bByResponse = ctx.detectorKind != DetectorKind::SHITOMASI;
+    bool bTopK = bLimit && bByResponse && !cfg.bAnms;
+    if (bTopK)
+    {
+        soa.topKMask(ctx.maxKeypoints, mask);
+        soa.compact(mask);
+    }
+    soa.toKeyPoints(keypoints);
+
+    if (bLimit)
+    {
+        if (!bTopK)
+        {
+            limitKeypoints(keypoints, ctx.maxKeypoints, bByResponse, cfg.bAnms);
+        }
+        addCounter("keypoints_after_limit", keypoints.size());
+        if (stageLoggingEnabled())
+        {
+            cout << " NOTE: Keypoints have been limited!\n";
+        }
+    }
+}
+
+// Detect keypoints with the configured detector, restrict them to the vehicle and limit their number
+void detectKeypoints(const PipelineConfig &cfg, PipelineContext &ctx, DataFrame &frame, bool bVis)
+{
+    /* DETECT IMAGE KEYPOINTS */
+
+    ScopedTimer timer("stage.detect");
+
+    const cv::Mat &imgGray = frame.cameraImg;
+
+    // extract 2D keypoints from current image straight into the frame, reusing the slot's keypoint storage
+    vector<cv::KeyPoint> &keypoints = frame.keypoints;
+    keypoints.clear();
+
+    //// STUDENT ASSIGNMENT
+    //// TASK MP.2 -> add the following keypoint detectors in file matching2D.cpp and enable string-based selection based on detectorType
+    //// -> HARRIS, FAST, BRISK, ORB, AKAZE, FREAK, SIFT
+
+    if (ctx.bUseOpenCL)
+    {
+        // the frame is uploaded once, description runs on the same device copy; the copy may only be queued,
+        // so the timer stops once the device has finished it
+        ScopedTimer upload("transfer.upload");
+        frame.cameraImg.copyTo(frame.cameraImgDevice);
+        cv::ocl::finish();
+        ctx.transferMs += upload.elapsedMs();
+    }
+
+    bool bRoiOnly = cfg.bFocusOnVehicle && cfg.bDetectInRoi;
+    bool bTiled = cfg.bTiledDetection && supportsTiledDetection(ctx.detectorKind);
+    if (bTiled)
+    {
+        // parallel detection per tile, with the keypoint limit spread evenly over the tiles
+        cv::Rect area = bRoiOnly ? cfg.vehicleRect : cv::Rect(0, 0, imgGray.cols, imgGray.rows);
+        bool bLimit = cfg.bLimitKpts || ctx.budget.bEnabled;
+        ctx.budget.candidates = detKeypointsTiled(keypoints, imgGray, area, ctx, cfg.tileGrid, bLimit ? ctx.maxKeypoints : 0);
+    }
+    else if (ctx.bUseOpenCL && ctx.detector)
+    {
+        detKeypointsDevice(keypoints, frame.cameraImgDevice, bRoiOnly ? cfg.vehicleRect : cv::Rect(), ctx);
+    }
+    else if (bRoiOnly)
+    {
+        // only run the detector on the (padded) vehicle region, keypoints come back in full-frame coordinates
+        detKeypointsRoi(keypoints, imgGray, cfg.vehicleRect, ctx, bVis);
+    }
+    else
+    {
+        detKeypoints(keypoints, imgGray, ctx, bVis);
+    }
+    //// EOF STUDENT ASSIGNMENT
+
+    selectKeypoints(cfg, ctx, keypoints, bTiled);
+
+    if (stageLoggingEnabled())
+    {
+        cout << "#2 : DETECT KEYPOINTS done\n";
+    }
+}
+
+// Compute the descriptors of the frame's keypoints
+void describeKeypoints(PipelineContext &ctx, DataFrame &frame)
+{
+    /* EXTRACT KEYPOINT DESCRIPTORS */
+
+    ScopedTimer timer("stage.describe");
+
+    //// STUDENT ASSIGNMENT
+    //// TASK MP.4 -> add the following descriptors in file matching2D.cpp and enable string-based selection based on descriptorType
+    //// -> BRIEF, ORB, FREAK, AKAZE, SIFT
+
+    if (ctx.bUseOpenCL)
+    {
+        descKeypoints(frame.keypoints, frame.cameraImgDevice, frame.descriptorsDevice, ctx);
+        if (ctx.bHostDescriptors)
+        {
+            cv::ocl::finish(); // the extractor's kernels are not part of the transfer
+            ScopedTimer download("transfer.download");
+            frame.descriptorsDevice.copyTo(frame.descriptors);
+            cv::ocl::finish();
+            ctx.transferMs += download.elapsedMs();
+        }
+        else
+        {
+            frame.descriptors.release(); // would still hold the descriptors of the slot's previous frame
+        }
+    }
+    else
+    {
+        // descriptors are computed straight into the frame so the slot's matrix is reused
+        descKeypoints(frame.keypoints, frame.cameraImg, frame.descriptors, ctx);
+    }
+    //// EOF STUDENT ASSIGNMENT
+
+    if (stageLoggingEnabled())
+    {
+        cout << "#3 : EXTRACT DESCRIPTORS done\n";
+    }
+}
+
+// Detect and describe with a single detectAndCompute call, so the scale space is built only once per frame.
+// detectAndCompute describes every keypoint it finds, and computing descriptors for given keypoints only
+// (useProvidedKeypoints) builds the scale space a second time. So the fused call is only used where the keypoints
+// it describes in vain are few: on the whole frame if no keypoint is discarded, or on the padded vehicle region if
+// the vehicle filter and the keypoint limit select from the region's keypoints afterwards.
+static bool useDetectAndCompute(const PipelineConfig &cfg, const PipelineContext &ctx, bool bVis)
+{
+    bool bLimits = cfg.bLimitKpts || ctx.budget.bEnabled;
+    bool bWholeFrameSelects = cfg.bFocusOnVehicle ? !cfg.bDetectInRoi : bLimits;
+    return cfg.bDetectAndCompute && !bWholeFrameSelects && !bVis && !ctx.bUseOpenCL &&
+           supportsDetectAndCompute(ctx);
+}
+
+static void detectAndComputeKeypoints(const PipelineConfig &cfg, PipelineContext &ctx, DataFrame &frame)
+{
+    ScopedTimer timer("stage.detect_describe");
+
+    frame.keypoints.clear();
+    bool bSelects = cfg.bFocusOnVehicle || cfg.bLimitKpts || ctx.budget.bEnabled;
+    if (!bSelects)
+    { // keypoints and descriptors are computed straight into the frame so the slot's storage is reused
+        detDescKeypoints(frame.keypoints, frame.descriptors, frame.cameraImg, cv::Rect(), ctx);
+    }
+    else
+    {
+        // the selection runs on copies tagged with their descriptor row, which then pick the frame's rows
+        thread_local vector<cv::KeyPoint> detected, selected; // storage is reused from frame to frame
+        thread_local cv::Mat descriptors;
+        detected.clear();
+        detDescKeypoints(detected, descriptors, frame.cameraImg, cfg.bFocusOnVehicle ? cfg.vehicleRect : cv::Rect(), ctx);
+        selected = detected;
+        for (size_t i = 0; i < selected.size(); ++i)
+        {
+            selected[i].class_id = (int)i;
+        }
+        selectKeypoints(cfg, ctx, selected, false);
+
+        frame.keypoints.resize(selected.size());
+        frame.descriptors.create((int)selected.size(), descriptors.cols, descriptors.type());
+        for (size_t i = 0; i < selected.size(); ++i)
+        {
+            int row = selected[i].class_id;
+            frame.keypoints[i] = detected[row];
+            cv::Mat dst = frame.descriptors.row((int)i);
+            descriptors.row(row).copyTo(dst);
+        }
+    }
+
+    if (stageLoggingEnabled())
+    {
+        cout << "#2 : DETECT KEYPOINTS AND EXTRACT DESCRIPTORS done\n";
+    }
+}
+
+// Every setting which changes the keypoints or descriptors of a frame. Apart from the three thresholds the detector
+// and extractor parameters are fixed in createDetector/createExtractor, bump the version whenever one of them changes.
+// The backend is part of it, as the OpenCL implementations may find slightly different keypoints than the CPU ones.
+string featureCacheKey(const PipelineConfig &cfg)
+{
+    ostringstream key;
+    key << "v2 backend=" << cfg.backend << " det=" << cfg.detectorType << " desc=" << cfg.descriptorType << " fast=" << cfg.thresholdFAST
+        << " harris=" << cfg.harrisMinResponse << " shitomasi=" << cfg.shiTomasiQualityLevel
+        << " gridnms=" << cfg.bGridNMS << " fusedharris=" << cfg.bFusedHarris << " dac=" << cfg.bDetectAndCompute
+        << " vehicle=" << cfg.bFocusOnVehicle << "," << cfg.vehicleRect.x << "," << cfg.vehicleRect.y << ","
+        << cfg.vehicleRect.width << "," << cfg.vehicleRect.height << " roi=" << cfg.bDetectInRoi
+        << " limit=" << cfg.bLimitKpts << "," << cfg.maxKeypoints << " anms=" << cfg.bAnms
+        << " tiled=" << cfg.bTiledDetection << "," << cfg.tileGrid.width << "x" << cfg.tileGrid.height;
+    return key.str();
+}
+
+// Look the frame up in the feature cache, true -> its keypoints and descriptors were loaded from cfg.featureCacheDir
+bool loadCachedFeatures(const PipelineConfig &cfg, DataFrame &frame)
+{
+    ScopedTimer timer("stage.cache_load");
+    string cacheKey = featureCacheKey(cfg);
+    uint64_t imgHash = imageHash(frame.cameraImg);
+    if (!loadFeatures(featureCacheFile(cfg.featureCacheDir, imgHash, cacheKey), imgHash, cacheKey, frame))
+    {
+        return false;
+    }
+    addCounter("feature_cache_hits", 1);
+    return true;
+}
+
+// Store the frame's keypoints and descriptors in cfg.featureCacheDir. The cache only saves time, so a file which
+// cannot be written is reported and the frame is processed on as if there was no cache.
+void storeCachedFeatures(const PipelineConfig &cfg, const DataFrame &frame)
+{
+    ScopedTimer timer("stage.cache_store");
+    string cacheKey = featureCacheKey(cfg);
+    uint64_t imgHash = imageHash(frame.cameraImg);
+    string cacheFile = featureCacheFile(cfg.featureCacheDir, imgHash, cacheKey);
+    if (!saveFeatures(cacheFile, imgHash, cacheKey, frame))
+    {
+        addCounter("feature_cache_write_errors", 1);
+        cerr << "WARNING: could not write feature cache file " << cacheFile << endl;
+    }
+}
+
+// Detect keypoints, restrict them to the vehicle and compute their descriptors
+void detectAndDescribe(const PipelineConfig &cfg, PipelineContext &ctx, DataFrame &frame, bool bVis)
+{
+    // with the feature cache, detection and description are skipped entirely for frames seen before
+    bool bCache = !cfg.featureCacheDir.empty();
+    if (bCache && loadCachedFeatures(cfg, frame))
+    {
+        return;
+    }
+
+    if (useDetectAndCompute(cfg, ctx, bVis))
+    {
+        detectAndComputeKeypoints(cfg, ctx, frame);
+    }
+    else
+    {
+        detectKeypoints(cfg, ctx, frame, bVis);
+        describeKeypoints(ctx, frame);
+    }
+
+    if (bCache)
+    {
+        storeCachedFeatures(cfg, frame);
+    }
+}
+
+// Match the descriptors of the current frame against the previous one and store the matches in the current frame
+// MAT_FLANN: the reference frame's descriptors query the index of the current frame, as knnMatch(descSource, descRef)
+// of the exhaustive matchers does, so the matches are those of a per-call FlannBasedMatcher. The index is built once
+// and kept in the current frame's slot: with matchHistory = K it serves all K older frames, and the cross-check
+// searches the reference frame's own index, which was built while that frame was the current one.
+// Matches come back in the DataFrame::kptMatches layout (queryIdx -> refFrame, trainIdx -> currFrame).
+static void matchFramesIndexed(PipelineContext &ctx, DataFrame &refFrame, DataFrame &currFrame, vector<cv::DMatch> &matches)
+{
+    DescriptorIndex &currIndex = descriptorIndex(currFrame, ctx.bBinaryDescriptors);
+    DescriptorIndex *refIndex = ctx.bCrossCheck ? &descriptorIndex(refFrame, ctx.bBinaryDescriptors) : nullptr;
+    matches.clear();
+    matchDescriptorsIndexed(refFrame.descriptors, currIndex, refIndex, matches, ctx);
+}
+
+static bool useFrameIndex(const PipelineContext &ctx)
+{
+    return ctx.matcherKind == MatcherKind::FLANN && !ctx.bGatedMatching;
+}
+
+void matchFrames(PipelineContext &ctx, DataFrame &prevFrame, DataFrame &currFrame)
+{
+    /* MATCH KEYPOINT DESCRIPTORS */
+
+    ScopedTimer timer("stage.match");
+
+    //// STUDENT ASSIGNMENT
+    //// TASK MP.5 -> add FLANN matching in file matching2D.cpp
+    //// TASK MP.6 -> add KNN match selection and perform descriptor distance ratio filtering with t=0.8 in file matching2D.cpp
+
+    currFrame.kptMatches.clear();
+    if (ctx.bUseOpenCL && !ctx.bHostDescriptors)
+    { // both frames' descriptors are still on the device, only the matches are downloaded
+        matchDescriptors(prevFrame.descriptorsDevice, currFrame.descriptorsDevice, currFrame.kptMatches, ctx);
+    }
+    else if (useFrameIndex(ctx))
+    {
+        matchFramesIndexed(ctx, prevFrame, currFrame, currFrame.kptMatches);
+    }
+    else
+    {
+        matchDescriptors(prevFrame.keypoints, currFrame.keypoints,
+                         prevFrame.descriptors, currFrame.descriptors,
+                         currFrame.kptMatches, ctx);
+    }
+
+    //// EOF STUDENT ASSIGNMENT
+
+    if (stageLoggingEnabled())
+    {
+        cout << "#4 : MATCH KEYPOINT DESCRIPTORS done\n";
+    }
+}
+
+// Match the frame at dataBuffer.current() against the previous one, or with cfg.matchHistory > 1 against up to that
+// many previous frames at once: kptMatches receives the matches with the previous frame, historyMatches those with
+// the older ones. MAT_FLANN queries the current frame's index with every reference frame, all other matchers use the
+// exhaustive batched matcher, which ignores matcherType and gating.
+void matchAgainstHistory(const PipelineConfig &cfg, PipelineContext &ctx, RingBuffer<DataFrame> &dataBuffer)
+{
+    DataFrame &frame = dataBuffer.current();
+    size_t numRefs = min((size_t)max(cfg.matchHistory, 1), dataBuffer.size() - 1);
+    if (numRefs == 0)
+    {
+        return;
+    }
+    if (cfg.matchHistory <= 1)
+    {
+        matchFrames(ctx, dataBuffer.previous(), frame);
+        return;
+    }
+
+    ScopedTimer timer("stage.match");
+    frame.historyMatches.resize(numRefs - 1);
+    if (useFrameIndex(ctx))
+    {
+        // every reference frame is looked up in the current frame's index, which is built only once
+        matchFramesIndexed(ctx, dataBuffer.previous(), frame, frame.kptMatches);
+        for (size_t k = 2; k <= numRefs; ++k)
+        {
+            matchFramesIndexed(ctx, dataBuffer.previous(k), frame, frame.historyMatches[k - 2].matches);
+        }
+    }
+    else
+    {
+        thread_local vector<const cv::Mat *> descRefs;
+        descRefs.clear();
+        for (size_t k = 1; k <= numRefs; ++k)
+        {
+            descRefs.push_back(&dataBuffer.previous(k).descriptors);
+        }
+        matchDescriptorsBatched(frame.descriptors, descRefs, ctx.stackedDescriptors, ctx.batchMatches,
+                                cfg.selectorType, ctx.ratio, ctx.bCrossCheck);
+
+        frame.kptMatches.swap(ctx.batchMatches[0]);
+        for (size_t k = 2; k <= numRefs; ++k)
+        {
+            frame.historyMatches[k - 2].matches.swap(ctx.batchMatches[k - 1]);
+        }
+    }
+
+    for (size_t k = 2; k <= numRefs; ++k)
+    {
+        FrameMatches &history = frame.historyMatches[k - 2];
+        history.frameIndex = dataBuffer.previous(k).frameIndex;
+        addCounter("matches_history", history.matches.size());
+    }
+    addCounter("matches", frame.kptMatches.size());
+
+    if (stageLoggingEnabled())
+    {
+        cout << "#4 : MATCH KEYPOINT DESCRIPTORS against " << numRefs << " frames done\n";
+    }
+}
+
+// Process the frame at dataBuffer.current() in tracking mode: keypoints of the previous frame are followed with
+// optical flow, and only every cfg.redetectInterval frames or once fewer than cfg.minTrackedKeypoints survive
+// are keypoints detected, described and matched from scratch. Both paths leave the frame's matches in kptMatches.
+void trackOrDetect(const PipelineConfig &cfg, PipelineContext &ctx, RingBuffer<DataFrame> &dataBuffer, bool bVis)
+{
+    DataFrame &frame = dataBuffer.current();
+    bool bHasPrevious = dataBuffer.size() > 1;
+
+    if (bHasPrevious && ctx.framesSinceDetection + 1 < cfg.redetectInterval)
+    {
+        ScopedTimer timer("stage.track");
+        cv::Rect roi = cfg.bFocusOnVehicle ? cfg.vehicleRect : cv::Rect();
+        int nTracked = trackKeypoints(dataBuffer.previous(), frame, roi, cfg.kltWinSize, cfg.kltMaxLevel);
+        if (nTracked >= cfg.minTrackedKeypoints)
+        {
+            ++ctx.framesSinceDetection;
+            if (stageLoggingEnabled())
+            {
+                cout << "#2 : TRACK KEYPOINTS done, " << nTracked << " keypoints\n";
+            }
+            return;
+        }
+        if (stageLoggingEnabled())
+        {
+            cout << " NOTE: only " << nTracked << " keypoints tracked, re-detecting\n";
+        }
+    }
+
+    addCounter("redetections", 1);
+    detectAndDescribe(cfg, ctx, frame, bVis);
+    ctx.framesSinceDetection = 0;
+    matchAgainstHistory(cfg, ctx, dataBuffer);
+}
+
+// Frame time fed to the keypoint budget: the interval from the start of detection (or tracking) to the end of
+// matching, i.e. the sum of the stage.detect, stage.describe (or stage.detect_describe), stage.match and stage.track
+// timers of the frame in the benchmark, measured directly so the controller also works with instrumentation off.
+// Loading and visualization are not part of it.
+static double msSince(double ticks)
+{
+    return 1000 * ((double)cv::getTickCount() - ticks) / cv::getTickFrequency();
+}
+
+// All stages one after another on the calling thread
+static void runSequential(const PipelineConfig &cfg, PipelineContext &ctx, FrameSource &source,
+                          RingBuffer<DataFrame> &dataBuffer, FrameCallback &onFrame, PipelineStats &stats)
+{
+    for (size_t imgIndex = 0; ; imgIndex++)
+    {
+        /* LOAD IMAGE INTO BUFFER */
+
+        // load straight into the slot of the oldest frame, which is recycled, and push it once the stream has delivered
+        if (!loadFrame(source, imgIndex, dataBuffer.nextSlot()))
+        {
+            break;
+        }
+        DataFrame &frame = dataBuffer.push();
+        if (stageLoggingEnabled())
+        {
+            cout << "#1 : LOAD IMAGE INTO BUFFER done\n";
+        }
+
+        double t = (double)cv::getTickCount();
+        if (cfg.bKltTracking)
+        {
+            trackOrDetect(cfg, ctx, dataBuffer, cfg.bVisKeypoints);
+        }
+        else
+        {
+            detectAndDescribe(cfg, ctx, frame, cfg.bVisKeypoints);
+
+            matchAgainstHistory(cfg, ctx, dataBuffer); // nothing to match until at least two images have been processed
+        }
+        // tracked frames tell nothing about the detector settings; detect/describe + match (+ track) of this frame
+        if (ctx.budget.bEnabled && ctx.framesSinceDetection == 0)
+        {
+            updateKeypointBudget(ctx, msSince(t), frame.keypoints.size());
+        }
+
+        if (onFrame)
+        {
+            onFrame(dataBuffer);
+        }
+        ++stats.frames;
+        matPoolEndFrame(); // the frame's temporaries are back in the pool
+    }
+}
+
+// Loading and detection/description run on their own threads and hand frames on through bounded queues,
+// so frame N+2 is loaded and frame N+1 is described while frame N is matched on the calling thread.
+// Every stage has exactly one thread, hence frames leave the pipeline in the order they were loaded.
+static void runPipelined(const PipelineConfig &cfg, PipelineContext &ctx, FrameSource &source,
+                         RingBuffer<DataFrame> &dataBuffer, FrameCallback &onFrame, PipelineStats &stats)
+{
+    BoundedQueue<DataFrame> loadedFrames(cfg.queueSize), describedFrames(cfg.queueSize);
+    exception_ptr loadError, detectError, matchError;
+    atomic<double> lastMatchMs(0.0); // the keypoint budget runs on the detector thread, matching is timed here
+
+    thread loader([&]() {
+        try
+        {
+            for (size_t imgIndex = 0; ; imgIndex++)
+            {
+                DataFrame frame;
+                if (!loadFrame(source, imgIndex, frame))
+                {
+                    break; // end of stream
+                }
+                if (!loadedFrames.push(std::move(frame)))
+                {
+                    break; // downstream stage has stopped
+                }
+            }
+        }
+        catch (...)
+        {
+            loadError = current_exception();
+        }
+        loadedFrames.close();
+    });
+
+    thread detector([&]() {
+        try
+        {
+            DataFrame frame;
+            while (loadedFrames.pop(frame))
+            {
+                // the detector thread owns ctx.detector and ctx.extractor, no visualization off the main thread;
+                // in tracking mode whether a frame needs detection is only known after tracking it, so both
+                // happen on the matching thread and this stage just hands frames on
+                if (!cfg.bKltTracking)
+                {
+                    double t = (double)cv::getTickCount();
+                    detectAndDescribe(cfg, ctx, frame, false);
+                    if (ctx.budget.bEnabled)
+                    { // detect/describe of this frame + stage.match of the last frame matched on the other thread
+                        updateKeypointBudget(ctx, msSince(t) + lastMatchMs, frame.keypoints.size());
+                    }
+                }
+                if (!describedFrames.push(std::move(frame)))
+                {
+                    break;
+                }
+            }
+        }
+        catch (...)
+        {
+            detectError = current_exception();
+            loadedFrames.close();
+        }
+        describedFrames.close();
+    });
+
+    try
+    {
+        DataFrame frame;
+        while (describedFrames.pop(frame))
+        {
+            DataFrame &slot = dataBuffer.push();
+            swap(slot, frame);
+
+            double t = (double)cv::getTickCount();
+            if (cfg.bKltTracking)
+            {
+                trackOrDetect(cfg, ctx, dataBuffer, false);
+                if (ctx.budget.bEnabled && ctx.framesSinceDetection == 0)
+                {
+                    updateKeypointBudget(ctx, msSince(t), dataBuffer.current().keypoints.size());
+                }
+            }
+            else
+            {
+                matchAgainstHistory(cfg, ctx, dataBuffer);
+                lastMatchMs = msSince(t);
+            }
+
+            if (onFrame)
+            {
+                onFrame(dataBuffer);
+            }
+            ++stats.frames;
+            matPoolEndFrame();
+        }
+    }
+    catch (...)
+    {
+        matchError = current_exception();
+        loadedFrames.close();
+        describedFrames.close();
+    }
+
+    loader.join();
+    detector.join();
+
+    if (loadError)
+    {
+        rethrow_exception(loadError);
+    }
+    if (detectError)
+    {
+        rethrow_exception(detectError);
+    }
+    if (matchError)
+    {
+        rethrow_exception(matchError);
+    }
+}
+
+// Process the configured image sequence, either stage by stage or pipelined over several threads
+PipelineStats runPipeline(const PipelineConfig &cfg, FrameCallback onFrame)
+{
+    // detector, extractor and matcher are created once and reused for all frames
+    PipelineContext ctx;
+    initPipelineContext(ctx, cfg);
+
+    // list of data frames which are held in memory at the same time, enough for matching against matchHistory frames
+    RingBuffer<DataFrame> dataBuffer(max(cfg.dataBufferSize, cfg.matchHistory + 1));
+    PipelineStats stats;
+
+    double t = (double)cv::getTickCount();
+
+    unique_ptr<FrameSource> source = createFrameSource(cfg);
+    ImagePrefetcher *prefetcher = dynamic_cast<ImagePrefetcher *>(source.get());
+
+    if (cfg.bPipelined)
+    {
+        runPipelined(cfg, ctx, *source, dataBuffer, onFrame, stats);
+    }
+    else
+    {
+        runSequential(cfg, ctx, *source, dataBuffer, onFrame, stats);
+    }
+    stats.seconds = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+
+    if (prefetcher)
+    {
+        stats.prefetch = prefetcher->stats();
+    }
+
+    return stats;
+}
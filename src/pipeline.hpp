@@ -0,0 +1,119 @@
+#ifndef pipeline_hpp
+#define pipeline_hpp
+
+#include <string>
+#include <memory>
+#include <functional>
+#include <opencv2/core.hpp>
+
+#include "dataStructures.h"
+#include "ringBuffer.h"
+#include "matching2D.hpp"
+#include "imagePrefetcher.hpp"
+#include "frameSource.hpp"
+
+
+struct PipelineConfig { // settings for processing one image sequence
+
+    // input
+    std::string sourceType = "IMAGES";           // IMAGES (numbered files, see below), VIDEO (file, URL or camera index), RAW
+    std::string sourceUri = "";                  // video file, stream URL or camera index for VIDEO, dump file for RAW
+    cv::Size rawFrameSize = cv::Size(1242, 375); // frame size of a RAW dump of 8bit grayscale frames
+
+    // data location of IMAGES
+    std::string imgBasePath = "../images/";
+    std::string imgPrefix = "KITTI/2011_09_26/image_00/data/000000"; // left camera, color
+    std::string imgFileType = ".png";
+    int imgStartIndex = 0; // first file index to load (assumes Lidar and camera names have identical naming convention)
+    int imgEndIndex = 9;   // last file index to load (< imgStartIndex -> read until the first missing file)
+    int imgFillWidth = 4;  // no. of digits which make up the file index (e.g. img-0001.png)
+
+    // processing
+    int dataBufferSize = 2;                 // no. of images which are held in memory (ring buffer) at the same time
+    std::string detectorType = "BRISK";     // SHITOMASI, HARRIS, FAST, BRISK, ORB, AKAZE, SIFT
+    std::string descriptorType = "AKAZE";   // BRIEF, ORB, FREAK, AKAZE, SIFT
+    std::string matcherType = "MAT_FLANN";  // MAT_BF, MAT_FLANN, MAT_HAMMING
+    std::string descriptorClass = "DES_BINARY"; // DES_BINARY, DES_HOG
+    std::string selectorType = "SEL_KNN";   // SEL_NN, SEL_KNN
+    int thresholdFAST = 80;                 // intensity difference between the centre and the circle pixels of FAST
+    int harrisMinResponse = 120;            // HARRIS corner threshold in the 8bit scaled response
+    float shiTomasiQualityLevel = 0.01f;    // SHITOMASI corner threshold relative to the strongest corner
+    float minDescDistRatio = 0.8f;          // SEL_KNN keeps matches with best < minDescDistRatio * second best
+    bool bCrossCheck = false;               // only keep mutual nearest neighbours (ungated matching only)
+    int matchHistory = 1;                   // > 1 -> match against that many previous frames in one batched pass
+    bool bGatedMatching = false;            // only match keypoints within gateRadius of their predicted position
+    float gateRadius = 40.0f;               // search radius of the gated matcher in pixels
+    bool bPredictMotion = true;             // shift the gate by the median keypoint motion of the previous frame pair
+    bool bGridNMS = true;                   // false -> original O(n^2) Harris NMS, kept for comparison
+    bool bFusedHarris = true;               // false -> cv::cornerHarris based Harris detector, kept for comparison
+    bool bFocusOnVehicle = true;            // only keep keypoints on the preceding vehicle
+    cv::Rect vehicleRect = cv::Rect(535, 180, 180, 150);
+    bool bDetectInRoi = true;               // run the detector on the padded vehicle region instead of the full frame
+    bool bLimitKpts = true;                 // limit number of keypoints (helpful for debugging and learning)
+    int maxKeypoints = 50;
+    bool bAnms = false;                     // spread the kept keypoints with adaptive non-maximal suppression
+    bool bTiledDetection = false;           // run SHITOMASI, HARRIS and FAST tile by tile on all cores
+    cv::Size tileGrid = cv::Size(4, 2);     // no. of tile columns and rows
+    bool bDetectAndCompute = true;          // one detectAndCompute call if detector and descriptor match (whole frame unfiltered, or vehicle region with bDetectInRoi)
+    bool bAdaptiveBudget = false;           // adjust maxKeypoints and the detector threshold every frame to meet frameDeadlineMs
+    float frameDeadlineMs = 50.0f;          // processing time per frame (detection, description, matching) to stay under
+    int minKeypointBudget = 20;             // bounds of the adaptive keypoint limit, which starts at maxKeypoints
+    int maxKeypointBudget = 2000;
+    bool bVisKeypoints = false;             // visualize detector results (ignored in pipelined mode)
+
+    // tracking
+    bool bKltTracking = false;              // propagate keypoints with optical flow instead of detecting on every frame
+    int redetectInterval = 5;               // run full detection and description at least every N frames
+    int minTrackedKeypoints = 20;           // re-detect as soon as fewer keypoints survive tracking
+    cv::Size kltWinSize = cv::Size(21, 21); // search window per pyramid level
+    int kltMaxLevel = 3;                    // no. of pyramid levels above the base image
+
+    // match visualization, rendered on its own thread (see visualizationSink.hpp)
+    std::string visSink = "NONE"; // NONE, WINDOW, VIDEO (video file visPath), SHM (preview file visPath)
+    std::string visPath = "";
+    float visFps = 10.0f;         // frame rate written to the VIDEO file
+    int visQueueSize = 2;         // max. no. of frame pairs waiting to be drawn, further frames are dropped
+
+    // feature cache
+    std::string featureCacheDir = ""; // reuse keypoints and descriptors stored in this directory (empty -> no cache)
+
+    // execution
+    std::string backend = "CPU"; // CPU, OPENCL (modern detectors, extractors and BF matching on cv::UMat)
+    bool bPipelined = false; // run load, detect/describe and match stages on separate threads
+    int queueSize = 2;       // max. no. of frames waiting between two pipeline stages
+    int prefetchSize = 0;    // no. of images decoded ahead on background threads (0 -> load synchronously, IMAGES only)
+    int prefetchThreads = 2; // no. of threads decoding images for the prefetcher
+    bool bPoolMats = true;   // reuse the Mat buffers of previous frames (process-wide, applied by the program, see matPool.hpp)
+
+    // diagnostics (process-wide, applied by the program, see instrumentation.hpp)
+    bool bLogStages = false;    // print per-stage messages to stdout
+    bool bInstrument = false;   // record per-stage timers and counters
+    bool bStageSummary = false; // print the per-stage latency histograms to stdout at the end (needs bInstrument)
+    std::string traceFile = ""; // write a Chrome trace of the run to this file (needs bInstrument, empty -> no trace)
+};
+
+struct PipelineStats { // summary of one run over an image sequence
+    std::size_t frames = 0;
+    double seconds = 0.0;
+    PrefetchStats prefetch; // only filled if images were prefetched
+};
+
+// called once per frame after matching, in frame order, with the current frame at dataBuffer.current()
+typedef std::function<void(RingBuffer<DataFrame> &dataBuffer)> FrameCallback;
+
+void initPipelineContext(PipelineContext &ctx, const PipelineConfig &cfg);
+std::string imageFilename(const PipelineConfig &cfg, std::size_t imgIndex);
+std::unique_ptr<FrameSource> createFrameSource(const PipelineConfig &cfg);
+bool loadFrame(FrameSource &source, std::size_t frameIndex, DataFrame &frame);
+void detectKeypoints(const PipelineConfig &cfg, PipelineContext &ctx, DataFrame &frame, bool bVis);
+void describeKeypoints(PipelineContext &ctx, DataFrame &frame);
+std::string featureCacheKey(const PipelineConfig &cfg);
+bool loadCachedFeatures(const PipelineConfig &cfg, DataFrame &frame);
+void storeCachedFeatures(const PipelineConfig &cfg, const DataFrame &frame);
+void detectAndDescribe(const PipelineConfig &cfg, PipelineContext &ctx, DataFrame &frame, bool bVis);
+void matchFrames(PipelineContext &ctx, DataFrame &prevFrame, DataFrame &currFrame);
+void matchAgainstHistory(const PipelineConfig &cfg, PipelineContext &ctx, RingBuffer<DataFrame> &dataBuffer);
+void trackOrDetect(const PipelineConfig &cfg, PipelineContext &ctx, RingBuffer<DataFrame> &dataBuffer, bool bVis);
+PipelineStats runPipeline(const PipelineConfig &cfg, FrameCallback onFrame);
+
+#endif /* pipeline_hpp */
@@ -0,0 +1,813 @@
+/* REGRESSION SUITE: PER-STAGE MICROBENCHMARKS WITH GOLDEN RESULT COUNTS AND TIMING BASELINES */
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <map>
+#include <memory>
+#include <string>
+#include <functional>
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+#include <cstdlib>
+#include <opencv2/core.hpp>
+
+#include "dataStructures.h"
+#include "matching2D.hpp"
+#include "pipeline.hpp"
+#include "configLoader.hpp"
+#include "matPool.hpp"
+#include "keypointBudget.hpp"
+#include "batchMatcher.hpp"
+
+using namespace std;
+
+struct StageCase { // one stage function with fixed parameters, called once per frame of the sequence
+    string name;                     // key in the baseline file, e.g. detKeypointsModern/FAST
+    size_t firstFrame;               // 1 for matching, which pairs every frame with the previous one
+    function<void(size_t)> prepare;  // untimed setup before each call (may be empty)
+    function<size_t(size_t)> run;    // timed call on one frame, returns its no. of keypoints, descriptors or matches
+};
+
+struct CaseResult {
+    string name;
+    size_t count = 0;        // keypoints, descriptors or matches summed over all frames
+    bool bStable = true;     // false -> the count differed between the timed runs
+    double msPerFrame = 0.0; // median over the timed runs
+    string error;            // set if the stage threw
+};
+
+struct Baseline {
+    size_t count;
+    double msPerFrame;
+};
+
+struct CheckCase { // untimed consistency check, returns an empty string if it passed and the reason otherwise
+    string name;
+    function<string()> run;
+};
+
+// The decoded sample frames as a frame source, so the pipeline cases reuse loadFrame and its slot reset
+class PreloadedSource : public FrameSource
+{
+public:
+    explicit PreloadedSource(const vector<cv::Mat> &images) : images(images), index(0) {}
+
+    bool read(cv::Mat &img) override
+    {
+        if (index >= images.size())
+        {
+            return false;
+        }
+        images[index++].copyTo(img);
+        return true;
+    }
+
+    void rewind() { index = 0; }
+
+private:
+    const vector<cv::Mat> &images;
+    size_t index;
+};
+
+struct PipelineRun { // one pipeline path over the sequence with the tracker's own stage functions
+    PipelineConfig cfg;
+    PipelineContext ctx;
+    RingBuffer<DataFrame> dataBuffer;
+    PreloadedSource source;
+
+    PipelineRun(const PipelineConfig &cfg, const vector<cv::Mat> &images)
+        : cfg(cfg), dataBuffer(cfg.dataBufferSize), source(images) {}
+};
+
+static double elapsedMs(double t)
+{
+    return 1000 * ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+}
+
+static CaseResult runCase(const StageCase &stage, size_t frames, int warmupRuns, int timedRuns)
+{
+    CaseResult result;
+    result.name = stage.name;
+    try
+    {
+        vector<double> runMs;
+        for (int run = 0; run < warmupRuns + timedRuns; ++run)
+        {
+            size_t count = 0;
+            double ms = 0.0;
+            for (size_t f = stage.firstFrame; f < frames; ++f)
+            {
+                if (stage.prepare)
+                {
+                    stage.prepare(f);
+                }
+                double t = (double)cv::getTickCount();
+                count += stage.run(f);
+                ms += elapsedMs(t);
+                matPoolEndFrame();
+            }
+            if (run < warmupRuns)
+            {
+                continue;
+            }
+            if (!runMs.empty() && count != result.count)
+            {
+                result.bStable = false;
+            }
+            result.count = count;
+            runMs.push_back(frames > stage.firstFrame ? ms / (frames - stage.firstFrame) : 0.0);
+        }
+        sort(runMs.begin(), runMs.end());
+        result.msPerFrame = runMs[runMs.size() / 2];
+    }
+    catch (const exception &e)
+    {
+        result.error = e.what();
+    }
+    return result;
+}
+
+// Both Harris implementations threshold and suppress the same 8bit scaled response, but compute it in a different
+// order, so a response may come out one step lower or higher. Corners found by both must agree in their response
+// within tolerance, a corner found by only one of them must be within tolerance of the threshold, or overlap a corner
+// of the other one with a response within tolerance.
+static string compareHarris(const vector<cv::Mat> &images, int minResponse, int tolerance)
+{
+    for (size_t f = 0; f < images.size(); ++f)
+    {
+        vector<cv::KeyPoint> kptsHarris, kptsFused;
+        detKeypointsHarris(kptsHarris, images[f], false, true, minResponse);
+        detKeypointsHarrisFused(kptsFused, images[f], false, true, minResponse);
+
+        const vector<cv::KeyPoint> *sets[2] = {&kptsHarris, &kptsFused};
+        for (int a = 0; a < 2; ++a)
+        {
+            const vector<cv::KeyPoint> &own = *sets[a], &other = *sets[1 - a];
+            for (auto kp = own.begin(); kp != own.end(); ++kp)
+            {
+                // a corner only one of them found may lie at the threshold or lost the NMS to a near-equal neighbour
+                bool bExplained = kp->response <= minResponse + tolerance;
+                for (auto op = other.begin(); op != other.end(); ++op)
+                {
+                    float dist = (float)cv::norm(kp->pt - op->pt);
+                    bool bClose = fabs(kp->response - op->response) <= tolerance;
+                    if (dist < 0.5f)
+                    { // found by both, the responses must agree
+                        bExplained = bClose;
+                        break;
+                    }
+                    bExplained |= dist < kp->size && bClose;
+                }
+                if (!bExplained)
+                {
+                    ostringstream os;
+                    os << "frame " << f << ": " << (a == 0 ? "Harris" : "HarrisFused") << " corner at (" << kp->pt.x << ","
+                       << kp->pt.y << ") with response " << kp->response << " differs from the other detector";
+                    return os.str();
+                }
+            }
+        }
+    }
+    return "";
+}
+
+// Feed the keypoint budget controller made-up frame times: overrunning frames with plenty of candidates must shrink
+// the limit down to minKeypointBudget and raise the detector threshold up to its bound, idle frames whose limit cuts
+// off keypoints must grow it back up to maxKeypointBudget and lower the threshold down to its bound. The limit and the
+// threshold must move in that direction only and stay within their bounds on every frame.
+static string checkKeypointBudget(const string &detectorType)
+{
+    PipelineConfig cfg;
+    cfg.detectorType = detectorType;
+    cfg.descriptorType = "BRISK";
+    cfg.bAdaptiveBudget = true;
+    cfg.frameDeadlineMs = 30.0f;
+    cfg.maxKeypoints = 200;
+    PipelineContext ctx;
+    initPipelineContext(ctx, cfg);
+
+    // the threshold of the detector and its bounds in adjustDetectorThreshold, higher -> fewer keypoints
+    function<double()> threshold;
+    double lowest = 0.0, highest = 0.0;
+    switch (ctx.detectorKind)
+    {
+    case DetectorKind::FAST:
+        threshold = [&ctx]() {
+            cv::FastFeatureDetector *fast = dynamic_cast<cv::FastFeatureDetector *>(ctx.detector.get());
+            if (!fast || fast->getThreshold() != ctx.thresholdFAST)
+            {
+                throw runtime_error("the FAST detector does not use thresholdFAST");
+            }
+            return (double)ctx.thresholdFAST;
+        };
+        lowest = 5;
+        highest = 150;
+        break;
+    case DetectorKind::HARRIS:
+        threshold = [&ctx]() { return (double)ctx.minResponseHarris; };
+        lowest = 30;
+        highest = 240;
+        break;
+    case DetectorKind::SHITOMASI:
+        threshold = [&ctx]() { return ctx.qualityLevelShiTomasi; };
+        lowest = 0.001;
+        highest = 0.3;
+        break;
+    default:
+        return "no adjustable threshold for " + detectorType;
+    }
+
+    struct Phase {
+        const char *name;
+        double frameMs;
+        size_t candidatesPerKeypoint; // candidates the detector delivers per keypoint of the limit
+        int direction;                // +1 -> fewer keypoints expected, -1 -> more
+    };
+    const Phase phases[] = {{"overrun", 100.0, 10, +1}, {"idle", 1.0, 1, -1}};
+    for (const Phase &phase : phases)
+    {
+        for (int frame = 0; frame < 300; ++frame)
+        {
+            int prevLimit = ctx.maxKeypoints;
+            double prevThreshold = threshold();
+            ctx.budget.candidates = phase.candidatesPerKeypoint * (size_t)ctx.maxKeypoints;
+            updateKeypointBudget(ctx, phase.frameMs, (size_t)ctx.maxKeypoints);
+
+            ostringstream os;
+            os << phase.name << " frame " << frame << ": ";
+            if (ctx.maxKeypoints < cfg.minKeypointBudget || ctx.maxKeypoints > cfg.maxKeypointBudget)
+            {
+                os << "limit " << ctx.maxKeypoints << " out of bounds";
+                return os.str();
+            }
+            if ((ctx.maxKeypoints - prevLimit) * phase.direction > 0)
+            {
+                os << "limit moved from " << prevLimit << " to " << ctx.maxKeypoints;
+                return os.str();
+            }
+            double t = threshold();
+            if (t < lowest - 1e-9 || t > highest + 1e-6 || (t - prevThreshold) * phase.direction < 0)
+            {
+                os << "threshold moved from " << prevThreshold << " to " << t;
+                return os.str();
+            }
+        }
+
+        int expectedLimit = phase.direction > 0 ? cfg.minKeypointBudget : cfg.maxKeypointBudget;
+        double expectedThreshold = phase.direction > 0 ? highest : lowest;
+        if (ctx.maxKeypoints != expectedLimit || fabs(threshold() - expectedThreshold) > 1e-6 * expectedThreshold)
+        {
+            ostringstream os;
+            os << phase.name << ": ended at limit " << ctx.maxKeypoints << " and threshold " << threshold()
+               << " instead of " << expectedLimit << " and " << expectedThreshold;
+            return os.str();
+        }
+    }
+    return "";
+}
+
+// A frame without keypoints has an empty descriptor Mat (no columns, or no rows). Matching it on either side has to
+// give no matches with every matcher and selector, as cv::BFMatcher does, instead of aborting the run.
+static string checkEmptyFrameMatching(const vector<cv::KeyPoint> &keypoints, const cv::Mat &descriptors)
+{
+    vector<string> matcherTypes = {"MAT_BF", "MAT_FLANN", "MAT_HAMMING"};
+    vector<string> selectorTypes = {"SEL_NN", "SEL_KNN"};
+    vector<cv::KeyPoint> noKeypoints;
+    cv::Mat emptyDescriptors[2] = {cv::Mat(), cv::Mat(0, descriptors.cols, descriptors.type())};
+    for (auto mat = matcherTypes.begin(); mat != matcherTypes.end(); ++mat)
+    {
+        for (auto sel = selectorTypes.begin(); sel != selectorTypes.end(); ++sel)
+        {
+            PipelineContext ctx;
+            initPipelineContext(ctx, "", "", *mat, "DES_BINARY", *sel);
+            for (int e = 0; e < 2; ++e)
+            {
+                for (int bEmptySource = 0; bEmptySource < 2; ++bEmptySource)
+                {
+                    vector<cv::DMatch> matches;
+                    try
+                    {
+                        if (bEmptySource)
+                        {
+                            matchDescriptors(noKeypoints, keypoints, emptyDescriptors[e], descriptors, matches, ctx);
+                        }
+                        else
+                        {
+                            matchDescriptors(keypoints, noKeypoints, descriptors, emptyDescriptors[e], matches, ctx);
+                        }
+                    }
+                    catch (const exception &ex)
+                    {
+                        return *mat + "/" + *sel + " threw on an empty frame: " + ex.what();
+                    }
+                    if (!matches.empty())
+                    {
+                        return *mat + "/" + *sel + " matched an empty frame";
+                    }
+                }
+            }
+        }
+    }
+    return "";
+}
+
+// Matching against two previous frames in one batched pass must give the same matches with the previous frame as the
+// pairwise brute-force matcher, for every selector with and without cross-check.
+static string checkBatchedMatching(const vector<cv::Mat> &descriptors)
+{
+    vector<string> selectorTypes = {"SEL_NN", "SEL_KNN"};
+    for (auto sel = selectorTypes.begin(); sel != selectorTypes.end(); ++sel)
+    {
+        for (int bCrossCheck = 0; bCrossCheck < 2; ++bCrossCheck)
+        {
+            PipelineContext ctx;
+            ctx.bCrossCheck = bCrossCheck != 0;
+            initPipelineContext(ctx, "", "", "MAT_BF", "DES_BINARY", *sel);
+            string name = *sel + (bCrossCheck ? "/cross-check" : "");
+            for (size_t f = 2; f < descriptors.size(); ++f)
+            {
+                vector<cv::DMatch> pairwise;
+                vector<cv::KeyPoint> kptsPrev(descriptors[f - 1].rows), kptsCurr(descriptors[f].rows);
+                matchDescriptors(kptsPrev, kptsCurr, descriptors[f - 1], descriptors[f], pairwise, ctx);
+
+                vector<const cv::Mat *> descRefs = {&descriptors[f - 1], &descriptors[f - 2]};
+                cv::Mat stacked;
+                vector<vector<cv::DMatch>> batched;
+                matchDescriptorsBatched(descriptors[f], descRefs, stacked, batched, *sel, ctx.ratio, ctx.bCrossCheck);
+
+                if (batched[0].size() != pairwise.size())
+                {
+                    return name + " frame " + to_string(f) + ": " + to_string(batched[0].size()) + " batched matches, " +
+                           to_string(pairwise.size()) + " pairwise";
+                }
+                for (size_t m = 0; m < pairwise.size(); ++m)
+                {
+                    const cv::DMatch &a = batched[0][m], &b = pairwise[m];
+                    if (a.queryIdx != b.queryIdx || a.trainIdx != b.trainIdx || fabs(a.distance - b.distance) > 1e-3f)
+                    {
+                        return name + " frame " + to_string(f) + ": batched match " + to_string(m) + " differs";
+                    }
+                }
+            }
+        }
+    }
+    return "";
+}
+
+// name count ms_per_frame per line, # starts a comment
+static map<string, Baseline> readBaseline(const string &filename)
+{
+    ifstream file(filename);
+    if (!file)
+    {
+        throw runtime_error("cannot read baseline " + filename + " (record one with --record)");
+    }
+    map<string, Baseline> baseline;
+    string line;
+    while (getline(file, line))
+    {
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+        istringstream is(line);
+        string name;
+        Baseline b;
+        if (!(is >> name >> b.count >> b.msPerFrame))
+        {
+            throw runtime_error("malformed baseline line: " + line);
+        }
+        baseline[name] = b;
+    }
+    if (baseline.empty())
+    {
+        throw runtime_error("baseline " + filename + " has no entries (record one with --record)");
+    }
+    return baseline;
+}
+
+static void writeBaseline(ostream &os, const vector<CaseResult> &results, size_t frames)
+{
+    os << "# 2D_feature_regression baseline over " << frames << " frames: name count ms_per_frame" << endl;
+    os << fixed << setprecision(4);
+    for (auto it = results.begin(); it != results.end(); ++it)
+    {
+        if (it->error.empty())
+        {
+            os << it->name << " " << it->count << " " << it->msPerFrame << endl;
+        }
+    }
+}
+
+static void printUsage(const char *name)
+{
+    cout << "Usage: " << name << " [--runs N] [--warmup N] [--baseline FILE] [--images DIR] [--record] [--filter TEXT]"
+         << " [--count-tolerance PCT] [--slowdown PCT] [--noise-ms MS] [--no-timing]" << endl;
+}
+
+/* MAIN PROGRAM */
+int main(int argc, const char *argv[])
+{
+    int timedRuns = 5;
+    int warmupRuns = 1;
+    string baselineFile = "../regression/baseline.txt";
+    string imgBasePath = "../images/";
+    bool bRecord = false;       // write the results as the new baseline instead of checking them
+    string filter = "";         // only run stages whose name contains this text
+    double countTolerance = 1.0; // max. deviation of a result count from the baseline, in percent
+    double slowdown = 20.0;     // max. increase of a stage's median latency over the baseline, in percent
+    double noiseMs = 0.05;      // latency differences below this are never reported as a slowdown
+    bool bTiming = true;        // false -> only check the result counts, e.g. on a machine other than the baseline's
+
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (arg == "--runs" && i + 1 < argc)
+        {
+            timedRuns = max(1, atoi(argv[++i]));
+        }
+        else if (arg == "--warmup" && i + 1 < argc)
+        {
+            warmupRuns = max(0, atoi(argv[++i]));
+        }
+        else if (arg == "--baseline" && i + 1 < argc)
+        {
+            baselineFile = argv[++i];
+        }
+        else if (arg == "--images" && i + 1 < argc)
+        {
+            imgBasePath = argv[++i];
+        }
+        else if (arg == "--record")
+        {
+            bRecord = true;
+        }
+        else if (arg == "--filter" && i + 1 < argc)
+        {
+            filter = argv[++i];
+        }
+        else if (arg == "--count-tolerance" && i + 1 < argc)
+        {
+            countTolerance = max(0.0, atof(argv[++i]));
+        }
+        else if (arg == "--slowdown" && i + 1 < argc)
+        {
+            slowdown = max(0.0, atof(argv[++i]));
+        }
+        else if (arg == "--noise-ms" && i + 1 < argc)
+        {
+            noiseMs = max(0.0, atof(argv[++i]));
+        }
+        else if (arg == "--no-timing")
+        {
+            bTiming = false;
+        }
+        else
+        {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    map<string, Baseline> baseline;
+    if (!bRecord)
+    {
+        try
+        {
+            baseline = readBaseline(baselineFile);
+        }
+        catch (const exception &e)
+        {
+            cerr << e.what() << endl;
+            return 1;
+        }
+    }
+
+    // the sample sequence as the tracker sees it: decoded once to grayscale, full frames
+    PipelineConfig cfg;
+    cfg.imgBasePath = imgBasePath;
+    enableMatPool();
+    vector<cv::Mat> images;
+    unique_ptr<FrameSource> source = createFrameSource(cfg);
+    cv::Mat img;
+    while (source->read(img))
+    {
+        images.push_back(img.clone());
+    }
+    size_t frames = images.size();
+
+    // inputs of the description and matching stages, computed once and untimed
+    PipelineContext briskCtx, akazeCtx;
+    initPipelineContext(briskCtx, "BRISK", "BRISK", "MAT_BF", "DES_BINARY", "SEL_NN");
+    initPipelineContext(akazeCtx, "AKAZE", "AKAZE", "MAT_BF", "DES_BINARY", "SEL_NN");
+    vector<vector<cv::KeyPoint>> briskKeypoints(frames), akazeKeypoints(frames);
+    vector<cv::Mat> briskDescriptors(frames);
+    for (size_t f = 0; f < frames; ++f)
+    {
+        detKeypointsModern(briskKeypoints[f], images[f], briskCtx, false);
+        detKeypointsModern(akazeKeypoints[f], images[f], akazeCtx, false);
+        vector<cv::KeyPoint> kpts = briskKeypoints[f];
+        descKeypoints(kpts, images[f], briskDescriptors[f], briskCtx);
+        briskKeypoints[f] = kpts; // the extractor drops keypoints it cannot describe, keep both in sync for matching
+    }
+
+    vector<StageCase> cases;
+    vector<CheckCase> checks;
+    vector<shared_ptr<PipelineContext>> contexts; // stage objects of the cases, reused by every call
+    vector<cv::KeyPoint> keypoints;
+    cv::Mat descriptors;
+    vector<cv::DMatch> matches;
+
+    // traditional detectors, both Harris variants must find the same corners, up to rounding at the threshold
+    checks.push_back({"compare/detKeypointsHarris/detKeypointsHarrisFused", [&]() { return compareHarris(images, 120, 1); }});
+    cases.push_back({"detKeypointsHarris", 0, nullptr, [&](size_t f) {
+        keypoints.clear();
+        detKeypointsHarris(keypoints, images[f], false, true);
+        return keypoints.size();
+    }});
+    cases.push_back({"detKeypointsHarrisFused", 0, nullptr, [&](size_t f) {
+        keypoints.clear();
+        detKeypointsHarrisFused(keypoints, images[f], false, true);
+        return keypoints.size();
+    }});
+    cases.push_back({"detKeypointsShiTomasi", 0, nullptr, [&](size_t f) {
+        keypoints.clear();
+        detKeypointsShiTomasi(keypoints, images[f], false);
+        return keypoints.size();
+    }});
+
+    // the keypoint budget controller on made-up frame times, for every detector with an adjustable threshold
+    vector<string> budgetDetectors = {"FAST", "HARRIS", "SHITOMASI"};
+    for (auto det = budgetDetectors.begin(); det != budgetDetectors.end(); ++det)
+    {
+        string detectorType = *det;
+        checks.push_back({"keypointBudget/" + detectorType, [detectorType]() { return checkKeypointBudget(detectorType); }});
+    }
+
+    // every algorithm the tracker implements, one which cannot be created fails the suite instead of going unguarded
+    vector<string> detectorTypes = {"FAST", "BRISK", "ORB", "AKAZE"};
+    for (auto det = detectorTypes.begin(); det != detectorTypes.end(); ++det)
+    {
+        shared_ptr<PipelineContext> ctx = make_shared<PipelineContext>();
+        initPipelineContext(*ctx, *det, "", "", "DES_BINARY", "");
+        if (!ctx->detector)
+        {
+            cerr << "detector " << *det << " is not available in this OpenCV build" << endl;
+            return 1;
+        }
+        contexts.push_back(ctx);
+        cases.push_back({"detKeypointsModern/" + *det, 0, nullptr, [&, ctx](size_t f) {
+            keypoints.clear();
+            detKeypointsModern(keypoints, images[f], *ctx, false);
+            return keypoints.size();
+        }});
+    }
+
+    // extractors on BRISK keypoints, AKAZE needs its own keypoints
+    vector<string> descriptorTypes = {"BRISK", "ORB", "AKAZE"};
+    for (auto desc = descriptorTypes.begin(); desc != descriptorTypes.end(); ++desc)
+    {
+        shared_ptr<PipelineContext> ctx = make_shared<PipelineContext>();
+        initPipelineContext(*ctx, "", *desc, "", "DES_BINARY", "");
+        if (!ctx->extractor)
+        {
+            cerr << "extractor " << *desc << " is not available in this OpenCV build" << endl;
+            return 1;
+        }
+        contexts.push_back(ctx);
+        const vector<vector<cv::KeyPoint>> *input = desc->compare("AKAZE") == 0 ? &akazeKeypoints : &briskKeypoints;
+        cases.push_back({"descKeypoints/" + *desc, 0, [&, input](size_t f) { keypoints = (*input)[f]; }, [&, ctx](size_t f) {
+            descKeypoints(keypoints, images[f], descriptors, *ctx);
+            return (size_t)descriptors.rows;
+        }});
+    }
+
+    checks.push_back({"matchDescriptorsBatched/history2", [&]() { return checkBatchedMatching(briskDescriptors); }});
+    checks.push_back({"matchDescriptors/empty-frame", [&]() { return checkEmptyFrameMatching(briskKeypoints[0], briskDescriptors[0]); }});
+
+    // matchers on the BRISK descriptors of consecutive frames, previous frame as source as in the tracker
+    vector<string> matcherTypes = {"MAT_BF", "MAT_FLANN", "MAT_HAMMING"};
+    vector<string> selectorTypes = {"SEL_NN", "SEL_KNN"};
+    for (auto mat = matcherTypes.begin(); mat != matcherTypes.end(); ++mat)
+    {
+        for (auto sel = selectorTypes.begin(); sel != selectorTypes.end(); ++sel)
+        {
+            for (int bCrossCheck = 0; bCrossCheck < 2; ++bCrossCheck)
+            {
+                if (bCrossCheck && mat->compare("MAT_BF") != 0)
+                {
+                    continue; // one cross-checked matcher is enough to guard the shared cross-check
+                }
+                shared_ptr<PipelineContext> ctx = make_shared<PipelineContext>();
+                ctx->bCrossCheck = bCrossCheck != 0;
+                initPipelineContext(*ctx, "", "", *mat, "DES_BINARY", *sel);
+                contexts.push_back(ctx);
+                string name = "matchDescriptors/" + *mat + "/" + *sel + (bCrossCheck ? "/cross-check" : "");
+                cases.push_back({name, 1, nullptr, [&, ctx](size_t f) {
+                    matches.clear();
+                    matchDescriptors(briskKeypoints[f - 1], briskKeypoints[f], briskDescriptors[f - 1],
+                                     briskDescriptors[f], matches, *ctx);
+                    return matches.size();
+                }});
+            }
+        }
+    }
+
+    // the tracker's paths from loading a frame into the ring buffer to its matches: the persistent FLANN index
+    // (matchFramesIndexed), matching against several previous frames, gated matching and KLT tracking
+    struct PipelineVariant {
+        string name;
+        function<void(PipelineConfig &)> configure;
+    };
+    vector<PipelineVariant> variants = {
+        {"MAT_FLANN", [](PipelineConfig &c) { c.matcherType = "MAT_FLANN"; }},
+        {"MAT_FLANN/cross-check", [](PipelineConfig &c) { c.matcherType = "MAT_FLANN"; c.bCrossCheck = true; }},
+        {"MAT_FLANN/history3", [](PipelineConfig &c) { c.matcherType = "MAT_FLANN"; c.matchHistory = 3; }},
+        {"MAT_BF/history3", [](PipelineConfig &c) { c.matchHistory = 3; }},
+        {"MAT_BF/gated", [](PipelineConfig &c) { c.bGatedMatching = true; }},
+        {"MAT_BF/klt", [](PipelineConfig &c) { c.bKltTracking = true; c.redetectInterval = 3; }},
+    };
+    for (auto var = variants.begin(); var != variants.end(); ++var)
+    {
+        PipelineConfig variantCfg = cfg;
+        variantCfg.detectorType = "BRISK";
+        variantCfg.descriptorType = "BRISK";
+        variantCfg.matcherType = "MAT_BF";
+        variantCfg.selectorType = "SEL_KNN";
+        var->configure(variantCfg);
+        variantCfg.dataBufferSize = max(variantCfg.dataBufferSize, variantCfg.matchHistory + 1);
+        try
+        {
+            validateConfig(variantCfg);
+        }
+        catch (const exception &e)
+        {
+            cerr << "pipeline/" << var->name << ": " << e.what() << endl;
+            return 1;
+        }
+        shared_ptr<PipelineRun> pr = make_shared<PipelineRun>(variantCfg, images);
+        auto reset = [pr](size_t f) {
+            if (f == 0)
+            { // every run starts from an empty buffer and a fresh context, as a new sequence would
+                pr->dataBuffer.clear();
+                pr->source.rewind();
+                initPipelineContext(pr->ctx, pr->cfg);
+            }
+            if (!loadFrame(pr->source, f, pr->dataBuffer.nextSlot()))
+            {
+                throw runtime_error("frame " + to_string(f) + " could not be loaded");
+            }
+            pr->dataBuffer.push();
+        };
+        cases.push_back({"pipeline/" + var->name, 0, reset, [pr](size_t f) {
+            if (pr->cfg.bKltTracking)
+            {
+                trackOrDetect(pr->cfg, pr->ctx, pr->dataBuffer, false);
+            }
+            else
+            {
+                detectAndDescribe(pr->cfg, pr->ctx, pr->dataBuffer.current(), false);
+                matchAgainstHistory(pr->cfg, pr->ctx, pr->dataBuffer);
+            }
+            const DataFrame &frame = pr->dataBuffer.current();
+            size_t count = frame.kptMatches.size();
+            for (auto it = frame.historyMatches.begin(); it != frame.historyMatches.end(); ++it)
+            {
+                count += it->matches.size();
+            }
+            return count;
+        }});
+    }
+
+    // run and compare
+    vector<CaseResult> results;
+    int failures = 0;
+    bool bAnyUnstable = false;
+    cout << left << setw(46) << "stage" << right << setw(10) << "count" << setw(10) << "golden" << setw(11) << "ms/frame"
+         << setw(11) << "baseline" << setw(9) << "delta" << "  status" << endl;
+    cout << fixed;
+    for (auto it = cases.begin(); it != cases.end(); ++it)
+    {
+        if (!filter.empty() && it->name.find(filter) == string::npos)
+        {
+            continue;
+        }
+        results.push_back(runCase(*it, frames, warmupRuns, timedRuns));
+        const CaseResult &r = results.back();
+        bAnyUnstable |= !r.bStable;
+
+        string status = "OK";
+        auto golden = baseline.find(r.name);
+        bool bKnown = golden != baseline.end();
+        if (!r.error.empty())
+        {
+            status = "FAILED (" + r.error + ")";
+        }
+        else if (bRecord)
+        {
+            status = "RECORDED";
+        }
+        else if (!bKnown)
+        {
+            status = "MISSING"; // an unguarded stage would pass whatever it returns, record the baseline again
+        }
+        else
+        {
+            const Baseline &b = golden->second;
+            double countDiff = fabs((double)r.count - (double)b.count);
+            if (countDiff > countTolerance / 100.0 * b.count)
+            {
+                status = "COUNT";
+            }
+            else if (bTiming && r.msPerFrame > b.msPerFrame * (1.0 + slowdown / 100.0) && r.msPerFrame - b.msPerFrame > noiseMs)
+            {
+                status = "SLOW";
+            }
+        }
+        if (status.compare("OK") != 0 && status.compare("RECORDED") != 0)
+        {
+            ++failures;
+        }
+
+        cout << left << setw(46) << r.name << right << setw(9) << r.count << (r.bStable ? " " : "*");
+        if (bKnown)
+        {
+            const Baseline &b = golden->second;
+            double delta = b.msPerFrame > 0.0 ? 100.0 * (r.msPerFrame - b.msPerFrame) / b.msPerFrame : 0.0;
+            cout << setw(10) << b.count << setprecision(3) << setw(11) << r.msPerFrame << setw(11) << b.msPerFrame
+                 << setprecision(1) << setw(8) << showpos << delta << noshowpos << "%";
+        }
+        else
+        {
+            cout << setw(10) << "-" << setprecision(3) << setw(11) << r.msPerFrame << setw(11) << "-" << setw(9) << "-";
+        }
+        cout << "  " << status << endl;
+    }
+
+    // baseline entries without a stage, e.g. a renamed or removed case, would otherwise drop out of the check unnoticed
+    for (auto it = baseline.begin(); it != baseline.end(); ++it)
+    {
+        if (!filter.empty() && it->first.find(filter) == string::npos)
+        {
+            continue;
+        }
+        bool bRun = false;
+        for (auto r = results.begin(); r != results.end() && !bRun; ++r)
+        {
+            bRun = r->name.compare(it->first) == 0;
+        }
+        if (!bRun)
+        {
+            ++failures;
+            cout << left << setw(46) << it->first << right << setw(10) << "-" << setw(10) << it->second.count
+                 << "  NO STAGE" << endl;
+        }
+    }
+
+    for (auto it = checks.begin(); it != checks.end(); ++it)
+    {
+        if (!filter.empty() && it->name.find(filter) == string::npos)
+        {
+            continue;
+        }
+        string error;
+        try
+        {
+            error = it->run();
+        }
+        catch (const exception &e)
+        {
+            error = e.what();
+        }
+        if (!error.empty())
+        {
+            ++failures;
+        }
+        cout << left << setw(46) << it->name << right << "  " << (error.empty() ? "OK" : "FAILED (" + error + ")") << endl;
+    }
+    if (bAnyUnstable)
+    {
+        cout << "* count differed between the timed runs, the last run is compared" << endl;
+    }
+
+    if (bRecord)
+    {
+        ofstream os(baselineFile);
+        if (!os)
+        {
+            cerr << "could not open " << baselineFile << " for writing" << endl;
+            return 1;
+        }
+        writeBaseline(os, results, frames);
+        cerr << "Baseline of " << results.size() << " stages written to " << baselineFile << endl;
+        return failures > 0 ? 1 : 0;
+    }
+
+    cerr << (failures > 0 ? to_string(failures) + " stage(s) regressed" : "No regressions") << " against " << baselineFile
+         << " (count tolerance " << countTolerance << "%, " << (bTiming ? "max. slowdown " + to_string((int)slowdown) + "%" : "timing not checked")
+         << ")" << endl;
+    return failures > 0 ? 1 : 0;
+}
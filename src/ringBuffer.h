@@ -0,0 +1,76 @@
+#ifndef ringBuffer_h
+#define ringBuffer_h
+
+#include <vector>
+#include <cstddef>
+#include <stdexcept>
+
+
+// Fixed-capacity ring buffer. Slots are allocated once at construction and reused in place,
+// so members of T which own memory (cv::Mat, std::vector) keep their storage between pushes.
+template <typename T>
+class RingBuffer
+{
+public:
+    explicit RingBuffer(std::size_t capacity) : slots(capacity), head(capacity - 1), count(0)
+    {
+        if (capacity == 0)
+        {
+            throw std::invalid_argument("RingBuffer capacity must be greater than zero");
+        }
+    }
+
+    // advance to the next slot and return it, once the buffer is full this is the oldest element
+    T &push()
+    {
+        head = (head + 1) % slots.size();
+        if (count < slots.size())
+        {
+            ++count;
+        }
+        return slots[head];
+    }
+
+    void push(const T &item) { push() = item; }
+
+    // slot the next push() will return, so it can be filled before it is committed; once the buffer is full
+    // this is the oldest element, which stays accessible until it has been overwritten
+    T &nextSlot() { return slots[(head + 1) % slots.size()]; }
+
+    // most recently pushed element
+    T &current() { return slots[head]; }
+    const T &current() const { return slots[head]; }
+
+    // element pushed k steps before the current one, previous(0) is current()
+    T &previous(std::size_t k = 1) { return slots[index(k)]; }
+    const T &previous(std::size_t k = 1) const { return slots[index(k)]; }
+
+    std::size_t size() const { return count; }
+    std::size_t capacity() const { return slots.size(); }
+    bool empty() const { return count == 0; }
+    bool full() const { return count == slots.size(); }
+
+    // forget all elements, the slots (and their storage) are kept
+    void clear()
+    {
+        head = slots.size() - 1;
+        count = 0;
+    }
+
+private:
+    std::size_t index(std::size_t k) const
+    {
+        if (k >= count)
+        {
+            throw std::out_of_range("RingBuffer::previous index exceeds number of stored elements");
+        }
+        return (head + slots.size() - k) % slots.size();
+    }
+
+    std::vector<T> slots;
+    std::size_t head;  // slot of the most recent element
+    std::size_t count; // no. of valid elements
+};
+
+
+#endif /* ringBuffer_h */
@@ -0,0 +1,60 @@
+#ifndef spscQueue_h
+#define spscQueue_h
+
+#include <vector>
+#include <atomic>
+#include <cstddef>
+
+
+// Lock-free FIFO queue of fixed capacity for exactly one producer and one consumer thread.
+// Neither side ever blocks: tryPush() fails on a full queue, tryPop() on an empty one.
+template <typename T>
+class SpscQueue
+{
+public:
+    explicit SpscQueue(std::size_t capacity) : slots((capacity > 0 ? capacity : 1) + 1), head(0), tail(0) {}
+
+    // producer side, item is left untouched if the queue is full
+    bool tryPush(T &&item)
+    {
+        std::size_t t = tail.load(std::memory_order_relaxed);
+        std::size_t next = increment(t);
+        if (next == head.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        slots[t] = std::move(item);
+        tail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // producer side, lets the producer skip preparing an item which would not fit anyway
+    bool full() const
+    {
+        return increment(tail.load(std::memory_order_relaxed)) == head.load(std::memory_order_acquire);
+    }
+
+    // consumer side
+    bool tryPop(T &item)
+    {
+        std::size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        item = std::move(slots[h]);
+        slots[h] = T(); // release what the slot holds now, not when it is overwritten
+        head.store(increment(h), std::memory_order_release);
+        return true;
+    }
+
+private:
+    std::size_t increment(std::size_t i) const { return i + 1 < slots.size() ? i + 1 : 0; }
+
+    std::vector<T> slots; // one slot stays empty to tell a full queue from an empty one
+    std::atomic<std::size_t> head; // next slot to pop, written by the consumer only
+    std::atomic<std::size_t> tail; // next slot to push, written by the producer only
+};
+
+
+#endif /* spscQueue_h */
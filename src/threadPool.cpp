@@ -0,0 +1,119 @@
+#include <algorithm>
+
+#include "threadPool.hpp"
+
+using namespace std;
+
+// index of the pool worker running on this thread, -1 for other threads
+static thread_local int currentWorker = -1;
+static thread_local const WorkStealingPool *currentPool = nullptr;
+
+WorkStealingPool::WorkStealingPool(int numThreads) : queued(0), pending(0), nextWorker(0), stopping(false)
+{
+    numThreads = max(1, numThreads);
+    for (int i = 0; i < numThreads; ++i)
+    {
+        workers.push_back(unique_ptr<Worker>(new Worker));
+    }
+    for (int i = 0; i < numThreads; ++i)
+    {
+        threads.push_back(thread(&WorkStealingPool::run, this, i));
+    }
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    wait();
+    {
+        lock_guard<mutex> lock(mtx);
+        stopping = true;
+    }
+    workAvailable.notify_all();
+    for (auto it = threads.begin(); it != threads.end(); ++it)
+    {
+        it->join();
+    }
+}
+
+void WorkStealingPool::submit(function<void()> task)
+{
+    size_t target;
+    {
+        // counted before the task is published, so a worker which pops it right away never takes queued below zero;
+        // a worker woken in between finds the deque still empty and checks again
+        lock_guard<mutex> lock(mtx);
+        target = (currentPool == this) ? (size_t)currentWorker : nextWorker++ % workers.size();
+        ++pending;
+        ++queued;
+    }
+    {
+        lock_guard<mutex> lock(workers[target]->mtx);
+        workers[target]->tasks.push_back(std::move(task));
+    }
+    workAvailable.notify_one();
+}
+
+void WorkStealingPool::wait()
+{
+    unique_lock<mutex> lock(mtx);
+    allDone.wait(lock, [this]() { return pending == 0; });
+}
+
+bool WorkStealingPool::tryPop(int self, function<void()> &task)
+{
+    // own deque first, newest task (its data is most likely still in cache)
+    {
+        Worker &own = *workers[self];
+        lock_guard<mutex> lock(own.mtx);
+        if (!own.tasks.empty())
+        {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            --queued;
+            return true;
+        }
+    }
+
+    // then steal the oldest task of the other workers
+    int n = (int)workers.size();
+    for (int k = 1; k < n; ++k)
+    {
+        Worker &victim = *workers[(self + k) % n];
+        lock_guard<mutex> lock(victim.mtx);
+        if (!victim.tasks.empty())
+        {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            --queued;
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::run(int self)
+{
+    currentWorker = self;
+    currentPool = this;
+    while (true)
+    {
+        function<void()> task;
+        if (tryPop(self, task))
+        {
+            task();
+            lock_guard<mutex> lock(mtx);
+            if (--pending == 0)
+            {
+                allDone.notify_all();
+            }
+            continue;
+        }
+
+        unique_lock<mutex> lock(mtx);
+        workAvailable.wait(lock, [this]() { return stopping || queued > 0; });
+        if (stopping && queued == 0)
+        {
+            return;
+        }
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef threadPool_hpp
+#define threadPool_hpp
+
+#include <deque>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+
+
+// Work-stealing thread pool. Every worker owns a task deque: it takes its own tasks newest first and, once that
+// runs dry, steals the oldest task of another worker, so long and short tasks balance out. Tasks submitted from
+// outside the pool are spread round-robin over the workers, tasks submitted by a worker go to its own deque.
+// Tasks must not throw.
+class WorkStealingPool
+{
+public:
+    explicit WorkStealingPool(int numThreads);
+    ~WorkStealingPool(); // finishes all submitted tasks first
+
+    WorkStealingPool(const WorkStealingPool &) = delete;
+    WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+    void submit(std::function<void()> task);
+    void wait(); // blocks until every submitted task has finished
+    int size() const { return (int)workers.size(); }
+
+private:
+    struct Worker {
+        std::deque<std::function<void()>> tasks;
+        std::mutex mtx;
+    };
+
+    bool tryPop(int self, std::function<void()> &task);
+    void run(int self);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+    std::atomic<std::size_t> queued;  // tasks waiting in any deque or about to be pushed to one
+    std::size_t pending;              // tasks submitted but not finished, guarded by mtx
+    std::size_t nextWorker;           // round-robin target for external submissions, guarded by mtx
+    bool stopping;
+    std::mutex mtx;
+    std::condition_variable workAvailable, allDone;
+};
+
+#endif /* threadPool_hpp */
@@ -0,0 +1,250 @@
+#include <iostream>
+#include <new>
+#include <cstring>
+#include <chrono>
+#include <stdexcept>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/videoio.hpp>
+#include <opencv2/features2d.hpp>
+
+#include "visualizationSink.hpp"
+#include "pipeline.hpp"
+#include "mappedFile.hpp"
+
+using namespace std;
+
+// HighGUI window, waitKey(1) only pumps its events. Platforms which require windows to be owned by the
+// main thread (macOS) cannot use this sink.
+class WindowSink : public VisualizationSink
+{
+public:
+    void write(const cv::Mat &img) override
+    {
+        string windowName = "Matching keypoints between two camera images";
+        if (!bWindowCreated)
+        {
+            cv::namedWindow(windowName, 7);
+            bWindowCreated = true;
+        }
+        cv::imshow(windowName, img);
+        cv::waitKey(1);
+    }
+
+private:
+    bool bWindowCreated = false;
+};
+
+// Motion JPEG file, opened with the size of the first image. Later images of another size are scaled to it.
+class VideoFileSink : public VisualizationSink
+{
+public:
+    VideoFileSink(const string &filename, double fps) : filename(filename), fps(fps) {}
+
+    void write(const cv::Mat &img) override
+    {
+        if (!writer.isOpened())
+        {
+            frameSize = img.size();
+            if (!writer.open(filename, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), fps, frameSize, img.channels() == 3))
+            {
+                throw runtime_error("could not open video file " + filename);
+            }
+        }
+        if (img.size() != frameSize)
+        {
+            cv::resize(img, scaled, frameSize);
+            writer.write(scaled);
+        }
+        else
+        {
+            writer.write(img);
+        }
+    }
+
+private:
+    string filename;
+    double fps;
+    cv::Size frameSize;
+    cv::VideoWriter writer;
+    cv::Mat scaled;
+};
+
+// Latest image in a memory-mapped file, for a viewer in another process. The file is recreated when the image
+// size or type changes, so readers check the header for every frame.
+class SharedMemorySink : public VisualizationSink
+{
+public:
+    explicit SharedMemorySink(const string &filename) : filename(filename) {}
+
+    void write(const cv::Mat &img) override
+    {
+        if (!file || header()->width != (uint32_t)img.cols || header()->height != (uint32_t)img.rows ||
+            header()->type != (uint32_t)img.type())
+        {
+            file.reset(); // unmap before the file is resized
+            file.reset(new MappedOutputFile(filename, sizeof(PreviewHeader) + img.total() * img.elemSize()));
+            PreviewHeader *h = new (file->data()) PreviewHeader();
+            memcpy(h->magic, "TRKPREV1", sizeof(h->magic));
+            h->width = img.cols;
+            h->height = img.rows;
+            h->type = img.type();
+            h->reserved = 0;
+            h->sequence.store(0, memory_order_release);
+        }
+
+        PreviewHeader *h = header();
+        uint64_t seq = h->sequence.load(memory_order_relaxed);
+        h->sequence.store(seq + 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        cv::Mat pixels(img.rows, img.cols, img.type(), file->data() + sizeof(PreviewHeader));
+        img.copyTo(pixels); // same size and type -> copied into the mapping
+        h->sequence.store(seq + 2, memory_order_release);
+    }
+
+private:
+    PreviewHeader *header() { return reinterpret_cast<PreviewHeader *>(file->data()); }
+
+    string filename;
+    unique_ptr<MappedOutputFile> file;
+};
+
+unique_ptr<VisualizationSink> createVisualizationSink(const PipelineConfig &cfg)
+{
+    if (cfg.visSink.compare("NONE") == 0)
+    {
+        return nullptr;
+    }
+    if (cfg.visSink.compare("WINDOW") == 0)
+    {
+        return unique_ptr<VisualizationSink>(new WindowSink());
+    }
+    if (cfg.visPath.empty())
+    {
+        throw invalid_argument("visSink " + cfg.visSink + " needs a visPath");
+    }
+    if (cfg.visSink.compare("VIDEO") == 0)
+    {
+        return unique_ptr<VisualizationSink>(new VideoFileSink(cfg.visPath, cfg.visFps));
+    }
+    if (cfg.visSink.compare("SHM") == 0)
+    {
+        return unique_ptr<VisualizationSink>(new SharedMemorySink(cfg.visPath));
+    }
+    throw invalid_argument("unknown visSink " + cfg.visSink);
+}
+
+MatchVisualizer::MatchVisualizer(unique_ptr<VisualizationSink> sink, size_t queueSize)
+    : sink(move(sink)), queue(queueSize), submitted(0), rendered(0), dropped(0), stopping(false)
+{
+    renderer = thread(&MatchVisualizer::renderLoop, this);
+}
+
+MatchVisualizer::~MatchVisualizer()
+{
+    close();
+}
+
+void MatchVisualizer::submit(const RingBuffer<DataFrame> &dataBuffer)
+{
+    if (dataBuffer.size() < 2)
+    {
+        return;
+    }
+    ++submitted;
+    if (queue.full())
+    {
+        ++dropped; // checked first so a dropped frame is not even copied
+        return;
+    }
+
+    // the images are copied because a video source decodes the next frames into the buffers of the ring buffer slots
+    const DataFrame &prevFrame = dataBuffer.previous(), &currFrame = dataBuffer.current();
+    MatchSnapshot snapshot;
+    snapshot.frameIndex = currFrame.frameIndex;
+    snapshot.prevImg = prevFrame.cameraImg.clone();
+    snapshot.currImg = currFrame.cameraImg.clone();
+    snapshot.prevKeypoints = prevFrame.keypoints;
+    snapshot.currKeypoints = currFrame.keypoints;
+    snapshot.matches = currFrame.kptMatches;
+    if (!queue.tryPush(move(snapshot)))
+    {
+        ++dropped;
+        return;
+    }
+    wakeUp.notify_one();
+}
+
+void MatchVisualizer::close()
+{
+    if (!renderer.joinable())
+    {
+        return;
+    }
+    stopping = true;
+    wakeUp.notify_one();
+    renderer.join();
+}
+
+VisualizerStats MatchVisualizer::stats() const
+{
+    VisualizerStats s;
+    s.submitted = submitted;
+    s.rendered = rendered;
+    s.dropped = dropped;
+    return s;
+}
+
+void MatchVisualizer::renderLoop()
+{
+    MatchSnapshot snapshot;
+    cv::Mat matchImg;
+    bool bFailed = false;
+    while (true)
+    {
+        // read before popping: every snapshot pushed before close() is then seen by the pop below
+        bool bStopping = stopping;
+        if (queue.tryPop(snapshot))
+        {
+            if (bFailed)
+            {
+                ++dropped;
+                continue;
+            }
+            try
+            {
+                cv::drawMatches(snapshot.prevImg, snapshot.prevKeypoints, snapshot.currImg, snapshot.currKeypoints,
+                                snapshot.matches, matchImg, cv::Scalar::all(-1), cv::Scalar::all(-1),
+                                vector<char>(), cv::DrawMatchesFlags::DRAW_RICH_KEYPOINTS);
+                sink->write(matchImg);
+                ++rendered;
+            }
+            catch (const exception &e)
+            {
+                cerr << "visualization stopped at frame " << snapshot.frameIndex << ": " << e.what() << endl;
+                bFailed = true;
+                ++dropped;
+            }
+            continue;
+        }
+        if (bStopping)
+        {
+            break;
+        }
+
+        // submit() notifies without the lock, so a wake-up can be missed; the timeout bounds the delay
+        unique_lock<mutex> lock(mtx);
+        wakeUp.wait_for(lock, chrono::milliseconds(10));
+    }
+    sink.reset(); // closes the video file before close() returns
+}
+
+unique_ptr<MatchVisualizer> createMatchVisualizer(const PipelineConfig &cfg)
+{
+    unique_ptr<VisualizationSink> sink = createVisualizationSink(cfg);
+    if (!sink)
+    {
+        return nullptr;
+    }
+    return unique_ptr<MatchVisualizer>(new MatchVisualizer(move(sink), cfg.visQueueSize > 0 ? cfg.visQueueSize : 1));
+}
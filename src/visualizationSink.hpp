@@ -0,0 +1,93 @@
+#ifndef visualizationSink_hpp
+#define visualizationSink_hpp
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+#include <opencv2/core.hpp>
+
+#include "dataStructures.h"
+#include "ringBuffer.h"
+#include "spscQueue.h"
+
+struct PipelineConfig; // pipeline.hpp
+
+
+// Output of the rendered match images, only ever called from the render thread of a MatchVisualizer
+class VisualizationSink
+{
+public:
+    virtual ~VisualizationSink() {}
+
+    // throws if the image cannot be written, the visualizer then stops rendering
+    virtual void write(const cv::Mat &img) = 0;
+};
+
+// Start of the preview file written by the SHM sink, followed by height rows of width * CV_ELEM_SIZE(type) bytes.
+// sequence is odd while a frame is being written: a reader copies the pixels between two equal, even reads of it.
+struct PreviewHeader {
+    char magic[8];                       // "TRKPREV1"
+    std::uint32_t width, height, type;   // type is the OpenCV matrix type, CV_8UC3 for match images
+    std::uint32_t reserved;
+    std::atomic<std::uint64_t> sequence; // 2 * no. of frames written so far
+};
+
+// NONE -> nullptr, WINDOW (HighGUI window, never waits for a key), VIDEO (video file cfg.visPath) or
+// SHM (latest image in the memory-mapped file cfg.visPath, see PreviewHeader), throws std::invalid_argument otherwise
+std::unique_ptr<VisualizationSink> createVisualizationSink(const PipelineConfig &cfg);
+
+struct MatchSnapshot { // everything needed to draw the matches of one frame pair, owned by the render thread
+    std::size_t frameIndex = 0;
+    cv::Mat prevImg, currImg;
+    std::vector<cv::KeyPoint> prevKeypoints, currKeypoints;
+    std::vector<cv::DMatch> matches;
+};
+
+struct VisualizerStats {
+    std::size_t submitted = 0; // frame pairs offered by the pipeline
+    std::size_t rendered = 0;  // ... drawn and written to the sink
+    std::size_t dropped = 0;   // ... skipped because the render thread was still busy
+};
+
+// Draws the matches of each frame pair on a background thread and hands the image to a sink.
+// The pipeline thread only copies the frame pair into a lock-free queue of queueSize snapshots and never waits:
+// while the queue is full, frames are dropped instead of stalling the pipeline.
+class MatchVisualizer
+{
+public:
+    MatchVisualizer(std::unique_ptr<VisualizationSink> sink, std::size_t queueSize);
+    ~MatchVisualizer();
+
+    MatchVisualizer(const MatchVisualizer &) = delete;
+    MatchVisualizer &operator=(const MatchVisualizer &) = delete;
+
+    // call from one thread only, e.g. the pipeline's FrameCallback
+    void submit(const RingBuffer<DataFrame> &dataBuffer);
+
+    // renders the snapshots still queued and stops the render thread, called by the destructor
+    void close();
+
+    VisualizerStats stats() const;
+
+private:
+    void renderLoop();
+
+    std::unique_ptr<VisualizationSink> sink;
+    SpscQueue<MatchSnapshot> queue;
+    std::atomic<std::size_t> submitted, rendered, dropped;
+    std::atomic<bool> stopping;
+
+    std::mutex mtx; // only used by the idle render thread to sleep on, submit() does not take it
+    std::condition_variable wakeUp;
+    std::thread renderer;
+};
+
+// nullptr if cfg.visSink is NONE, so a disabled visualizer adds neither a thread nor a frame callback
+std::unique_ptr<MatchVisualizer> createMatchVisualizer(const PipelineConfig &cfg);
+
+#endif /* visualizationSink_hpp */